@@ -52,6 +52,7 @@ class OpenFile {
 		}
 
     int Length() { Lseek(file, 0, 2); return Tell(file); }
+    int Identity() { return FileIdentity(file); }
     
   private:
     int file;
@@ -86,9 +87,13 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+    int Identity() { return hdrSector; }
+					// Tell this file apart from any
+					// other file: its header sector
     
   private:
     FileHeader *hdr;			// Header for this file 
+    int hdrSector;			// Where the header is on disk
     int seekPosition;			// Current position within the file
 };
 
@@ -24,6 +24,8 @@
 #include "interrupt.h"
 #include "system.h"
 
+#include <limits.h>		// for INT_MAX
+
 // String definitions for debugging messages
 
 static const char *intLevelNames[] = { "off", "on"};
@@ -60,7 +62,7 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, void* param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List<PendingInterrupt*>;
+    pending = new Heap<PendingInterrupt>;
     inHandler = false;
     yieldOnReturn = false;
     status = SystemMode;
@@ -73,8 +75,6 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete pending->Remove();
     delete pending;
 }
 
@@ -146,19 +146,23 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	"count" is the number of ticks to charge at once; the machine
+//	runs user instructions in batches that never go past Deadline(),
+//	so nothing can have come due before the last of them.
 //----------------------------------------------------------------------
 void
-Interrupt::OneTick()
+Interrupt::OneTick(int count)
 {
     MachineStatus old = status;
 
 // advance simulated time
     if (status == SystemMode) {
-        stats->totalTicks += SystemTick;
-	stats->systemTicks += SystemTick;
+        stats->totalTicks += SystemTick * count;
+	stats->systemTicks += SystemTick * count;
     } else {					// USER_PROGRAM
-	stats->totalTicks += UserTick;
-	stats->userTicks += UserTick;
+	stats->totalTicks += UserTick * count;
+	stats->userTicks += UserTick * count;
     }
     DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
 
@@ -178,6 +182,25 @@ Interrupt::OneTick()
     }
 }
 
+//----------------------------------------------------------------------
+// Interrupt::Deadline
+// 	Return the time at which the earliest pending interrupt is due.
+//	Until then OneTick has nothing to do but advance the clock, so the
+//	machine can run user instructions without calling it.
+//
+//	Only valid until the next Schedule, or until an interrupt fires.
+//----------------------------------------------------------------------
+
+int
+Interrupt::Deadline()
+{
+    int when;
+
+    if (!pending->PeekMin(NULL, &when))
+	return INT_MAX;			// nothing will ever interrupt us
+    return when;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::YieldOnReturn
 // 	Called from within an interrupt handler, to cause a context switch
@@ -256,23 +279,22 @@ Interrupt::Halt()
 
 #ifdef DFS_TICKS_FIX
 
-void Interrupt::RestartTicks()
+static void
+RestartPending(PendingInterrupt *i)
 {
-    PendingInterrupt *i = NULL;
-    int newWhen, oldWhen = 0;
+    int newWhen = i->when - stats->totalTicks;
 
-    List<PendingInterrupt*> *oldPending = pending;
-    pending = new List<PendingInterrupt*>;
-
-    while ((i = oldPending->SortedRemove(&oldWhen)) != NULL)
-    {
-        newWhen = oldWhen - stats->totalTicks;
-        pending->SortedInsert(i, newWhen);
-        DEBUG('x', "[%s]: Interrupt at time %d re-scheduled at new time %d.\n",
-              __FUNCTION__, oldWhen, newWhen);
-    }
+    DEBUG('x', "[%s]: Interrupt at time %d re-scheduled at new time %d.\n",
+          __FUNCTION__, i->when, newWhen);
+    i->when = newWhen;
+}
 
-    delete oldPending;
+void Interrupt::RestartTicks()
+{
+    // Moving every interrupt back by the same amount keeps them in
+    // order, and keeps their handles valid
+    pending->Apply(RestartPending);
+    pending->ShiftKeys(stats->totalTicks);
     stats->totalTicks = 0;
     stats->numBugFix += 1;
 }
@@ -283,7 +305,8 @@ void Interrupt::RestartTicks()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: just put it on a heap, sorted by time.  Interrupts
+//	scheduled for the same time occur in the order they were scheduled.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -293,8 +316,11 @@ void Interrupt::RestartTicks()
 //	"fromNow" is how far in the future (in simulated time) the 
 //		 interrupt is to occur
 //	"type" is the hardware device that generated the interrupt
+//
+// Returns:
+//	A handle, to Cancel the interrupt before it occurs.
 //----------------------------------------------------------------------
-void
+unsigned
 Interrupt::Schedule(VoidFunctionPtr handler, void* arg, int fromNow, IntType type)
 {
     int when = stats->totalTicks + fromNow;
@@ -309,13 +335,35 @@ Interrupt::Schedule(VoidFunctionPtr handler, void* arg, int fromNow, IntType typ
     // This assert terminates Nachos if the ticks overflowed
     ASSERT(when >= 0);
 #endif
-    PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
+    PendingInterrupt toOccur(handler, arg, when, type);
 
     DEBUG('i', "Scheduling interrupt handler the %s at time = %d\n", 
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    return pending->Insert(toOccur, when);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Cancel
+// 	Unschedule an interrupt, so that it never occurs.  Like Schedule,
+//	only to be called by the hardware device simulators.
+//
+//	"handle" is what Schedule returned for the interrupt
+//
+// Returns:
+//	false, if the interrupt had already occurred (or been cancelled).
+//----------------------------------------------------------------------
+bool
+Interrupt::Cancel(unsigned handle)
+{
+    PendingInterrupt cancelled;
+
+    if (!pending->Cancel(handle, &cancelled))
+	return false;
+    DEBUG('i', "Cancelling interrupt handler the %s at time = %d\n", 
+				intTypeNames[cancelled.type], cancelled.when);
+    return true;
 }
 
 //----------------------------------------------------------------------
@@ -341,29 +389,27 @@ Interrupt::CheckIfDue(bool advanceClock)
 					// to invoke an interrupt handler
     if (DebugIsEnabled('i'))
 	DumpState();
-    PendingInterrupt *toOccur = 
-		pending->SortedRemove(&when);
+    PendingInterrupt toOccur;
 
-    if (toOccur == NULL)		// no pending interrupts
+    if (!pending->PeekMin(&toOccur, &when))	// no pending interrupts
 	return false;			
 
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-	pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks) {	// not time yet, leave it
 	return false;
     }
 
 // Check if there is nothing more to do, and if so, quit
-    if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+    if ((status == IdleMode) && (toOccur.type == TimerInt) 
+				&& (pending->NumItems() == 1)) {
 	 return false;
     }
+    pending->RemoveMin(&toOccur, &when);
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
-			intTypeNames[toOccur->type], toOccur->when);
+			intTypeNames[toOccur.type], toOccur.when);
 #ifdef USER_PROGRAM
     if (machine != NULL)
     	machine->DelayedLoad(0, 0);
@@ -372,10 +418,9 @@ Interrupt::CheckIfDue(bool advanceClock)
     status = SystemMode;			// whatever we were doing,
 						// we are now going to be
 						// running in the kernel
-    (*(toOccur->handler))(toOccur->arg);	// call the interrupt handler
+    (*(toOccur.handler))(toOccur.arg);	// call the interrupt handler
     status = old;				// restore the machine status
     inHandler = false;
-    delete toOccur;
     return true;
 }
 
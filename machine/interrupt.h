@@ -36,7 +36,7 @@
 #define INTERRUPT_H
 
 #include "copyright.h"
-#include "list.h"
+#include "heap.h"
 
 // Interrupts can be disabled (IntOff) or enabled (IntOn)
 enum IntStatus { IntOff, IntOn };
@@ -58,6 +58,7 @@ enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt,
 
 class PendingInterrupt {
   public:
+    PendingInterrupt() {}	// for the slots of the pending heap
     PendingInterrupt(VoidFunctionPtr func, void* param, int time, IntType kind);
 				// initialize an interrupt that will
 				// occur in the future
@@ -106,16 +107,23 @@ class Interrupt {
     // but they need to be public since they are called by the
     // hardware device simulators.
 
-    void Schedule(VoidFunctionPtr handler,// Schedule an interrupt to occur
+    unsigned Schedule(VoidFunctionPtr handler,// Schedule an interrupt to occur
 	void* arg, int when, IntType type);// at time ``when''.  This is called
     					// by the hardware device simulators.
+					// Returns a handle for Cancel
+    bool Cancel(unsigned handle);	// Unschedule an interrupt that has
+					// not occurred yet
     
-    void OneTick();       		// Advance simulated time
+    void OneTick(int count = 1);	// Advance simulated time by "count"
+					// ticks of the current mode
+
+    int Deadline();			// Time at which the earliest pending
+					// interrupt is due
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List<PendingInterrupt*> *pending;	// the list of interrupts scheduled
-				// to occur in the future
+    Heap<PendingInterrupt> *pending;	// the interrupts scheduled to
+				// occur in the future, by time
     bool inHandler;		// true if we are running an interrupt handler
     bool yieldOnReturn; 	// true if we are to context switch
 				// on return from the interrupt handler
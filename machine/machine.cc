@@ -50,9 +50,13 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"blocks" -- if TRUE, execute user code a basic block at a time,
+//		through the translated (threaded) form of each page.
+//	"ways" -- associativity of the TLB, if there is one: 1 for a
+//		direct mapped TLB, TLBSize for a fully associative one.
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, bool blocks, int ways)
 {
     int i;
 
@@ -61,17 +65,36 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
+    decodedPages = new Instruction[NumPhysPages * InstrsPerPage];
+    threadedPages = new ThreadedOp[NumPhysPages * InstrsPerPage];
+    for (i = 0; i < NumPhysPages; i++)
+	decodedValid[i] = threadedValid[i] = false;
+    ASSERT((ways > 0) && (TLBSize % ways == 0));
+    tlbWays = ways;
+    tlbSets = TLBSize / ways;
+    tlbValid = 0;
+    for (i = 0; i < TLBHashSize; i++)
+	tlbHash[i] = -1;
+    currentAsid = 0;
+    fetchPage = fetchFrame = -1;
+    codePage = dataPage = -1;
+    codeEntry = dataEntry = NULL;
+    useShortcuts = !DebugIsEnabled('n');	// keep tracing every lookup
 #ifdef USE_TLB
     tlb = new TranslationEntry[TLBSize];
     for (i = 0; i < TLBSize; i++)
 	tlb[i].valid = false;
     pageTable = NULL;
+    stats->tlbWays = tlbWays;
+    stats->tlbSets = tlbSets;
 #else	// use linear page table
     tlb = NULL;
     pageTable = NULL;
 #endif
 
     singleStep = debug;
+    runBlocks = blocks;
+    pendingTicks = 0;
     CheckEndian();
 }
 
@@ -83,6 +106,8 @@ Machine::Machine(bool debug)
 Machine::~Machine()
 {
     delete [] mainMemory;
+    delete [] decodedPages;
+    delete [] threadedPages;
     if (tlb != NULL)
         delete [] tlb;
 }
@@ -93,6 +118,11 @@ Machine::~Machine()
 //	the user program either invoked a system call, or some exception
 //	occured (such as the address translation failed).
 //
+//	The time of the instructions run so far in the current batch is
+//	charged before the kernel runs, so that it sees the same clock as
+//	if they had been charged one by one.  The trapping instruction
+//	itself is charged when we return, as usual.
+//
 //	"which" -- the cause of the kernel trap
 //	"badVaddr" -- the virtual address causing the trap, if appropriate
 //----------------------------------------------------------------------
@@ -103,6 +133,12 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
     DEBUG('m', "Exception: %s\n", exceptionNames[which]);
     
 //  ASSERT(interrupt->getStatus() == UserMode);
+    if (pendingTicks > 0) {
+	int ticks = pendingTicks;
+
+	pendingTicks = 0;
+	interrupt->OneTick(ticks);
+    }
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
     interrupt->setStatus(SystemMode);
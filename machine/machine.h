@@ -35,6 +35,9 @@ const int PageSize = SectorSize; 	// set the page size equal to
 const int NumPhysPages = 64;
 const int MemorySize = NumPhysPages * PageSize;
 const int TLBSize = 32;			    // if there is a TLB, make it small
+const int TLBHashSize = 2 * TLBSize;	    // buckets of the host-side index
+					    // of a fully associative TLB
+const int InstrsPerPage = PageSize / 4;	    // instruction words per page
 
 enum ExceptionType { NoException,   // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -91,6 +94,26 @@ class Instruction {
                      // Immediates are sign-extended.
 };
 
+// The following structure defines an instruction translated for the block
+// execution engine (see Machine::RunBlock): the decoded operands, plus a
+// pointer to the routine that executes that particular operation, so
+// that running it does not need to go through the big opcode switch.
+//
+// "count" is the number of instructions in the straight-line block that
+// starts here, up to and including the delay slot of the branch that
+// ends it, without leaving the page.  0 means "use the interpreter".
+
+class Machine;
+struct ThreadedOp;
+typedef bool (*OpHandler)(Machine *machine, ThreadedOp *op);
+
+struct ThreadedOp {
+    OpHandler run;	// executes the instruction; false if it trapped
+    int rs, rt, rd;	// registers, as in Instruction
+    int extra;		// immediate, already extended/shifted as needed
+    int count;		// length of the block starting at this instruction
+};
+
 // The following class defines the simulated host workstation hardware, as 
 // seen by user programs -- the CPU registers, main memory, etc.
 // User programs shouldn't be able to tell that they are running on our 
@@ -106,8 +129,11 @@ class Instruction {
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
-                            // for running user programs
+    Machine(bool debug, bool blocks = false, int ways = TLBSize);
+    				// Initialize the simulation of the hardware
+                            	// for running user programs; "blocks"
+				// selects the block execution engine,
+				// "ways" the associativity of the TLB
     ~Machine();			    // De-allocate the data structures
 
    // Routines callable by the Nachos kernel
@@ -118,13 +144,54 @@ class Machine {
     void WriteRegister(int num, int value);
 				// store a value into a CPU register
 
+    int TLBSetStart(int vpn);	// First TLB slot where "vpn" may be loaded;
+    int TLBWays() { return tlbWays; }
+				// it may go in any of the next TLBWays()
+    void SetASID(int asid);	// Address space of the translations used
+    int ASID() { return currentAsid; }	// from now on
+    int LookupTLB(int vpn) { return LookupTLB(vpn, currentAsid); }
+    int LookupTLB(int vpn, int asid);
+				// TLB slot holding "vpn" for "asid", or -1
+    void LoadTLBEntry(int slot, TranslationEntry *entry);
+				// Load a translation of the current address
+				// space into a TLB slot (which must be in
+				// the set for its page)
+    void UpdateTLBEntry(int slot, TranslationEntry *entry);
+				// Change the frame and protection of the
+				// translation in "slot", in place
+    void InvalidateTLBEntry(int slot);
+    void InvalidateTLBPage(int vpn, int asid);
+				// Invalidate the translation of "vpn" for
+				// "asid", if the TLB has it
+    void FlushTLB();		// Invalidate every TLB entry
+
 
 // Routines internal to the machine simulation -- DO NOT call these 
 
-    void OneInstruction(Instruction *instr); 	
+    void RunBatch(Instruction *instr);
+				// Run user instructions up to the next
+				// interrupt, then advance the clock
+    bool OneInstruction(Instruction *instr); 	
     				// Run one instruction of a user program.
+				// Returns false if it trapped to the kernel
+    bool Execute(Instruction *instr);
+				// Execute an already fetched instruction
+    bool RunBlock(Instruction *instr, int limit);
+				// Run the straight-line block of user
+				// instructions at the PC, at most "limit"
+				// of them
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
+    Instruction *DecodedAt(int physAddr);
+				// Return the pre-decoded instruction stored
+				// at "physAddr", decoding its page if needed
+    ThreadedOp *ThreadedAt(int physAddr);
+				// Same, translated for the block engine
+    void InvalidateDecodedPage(int frame);
+				// Throw away the pre-decoded instructions of
+				// physical page "frame".  Must be called
+				// whenever the page is written behind the
+				// simulator's back (loaded, swapped, reused)
     
     bool ReadMem(int addr, int size, int* value);
     bool WriteMem(int addr, int size, int value);
@@ -132,6 +199,8 @@ class Machine {
 				// memory (at addr).  Return false if a 
 				// correct translation couldn't be found.
     
+    ExceptionType TranslateFetch(int virtAddr, int* physAddr);
+    				// Translate the address of an instruction
     ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
     				// Translate an address, and check for 
 				// alignment.  Set the use and dirty bits in 
@@ -173,8 +242,25 @@ class Machine {
 // For simplicity, both the page table pointer and the TLB pointer are
 // public.  However, while there can be multiple page tables (one per address
 // space, stored in memory), there is only one TLB (implemented in hardware).
-// Thus the TLB pointer should be considered as *read-only*, although 
-// the contents of the TLB are free to be modified by the kernel software.
+// Thus the TLB pointer should be considered as *read-only*.  The kernel
+// may read (and update the use and dirty bits of) the TLB entries, but
+// it must load, change and invalidate them through LoadTLBEntry,
+// UpdateTLBEntry, InvalidateTLBEntry and FlushTLB, so the machine can
+// keep its lookup structures up to date.
+//
+// The TLB is organized in TLBSize / TLBWays() sets of TLBWays() entries;
+// a page can only be loaded in the set it maps to (TLBSetStart).  With
+// one way the TLB is direct mapped.  With TLBSize ways it is fully
+// associative, and the machine keeps a hash index on the virtual page
+// numbers, so that a lookup does not scan every entry.
+//
+// As in the MIPS R4000, every TLB entry is tagged with the address
+// space identifier (ASID) that was current when it was loaded, and
+// only matches while that ASID is current.  So the kernel does not
+// have to flush the TLB on a context switch; it just calls SetASID.
+// The ASID is mixed into the set (and hash bucket) a page maps to, so
+// that the same pages of different address spaces do not all compete
+// for the same slots.
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
@@ -183,6 +269,38 @@ class Machine {
     unsigned int pageTableSize;
 
   private:
+    Instruction *decodedPages;	// pre-decoded copy of every word in
+				// mainMemory, filled a page at a time
+    bool decodedValid[NumPhysPages]; // is the pre-decoded copy of each
+				// physical page up to date?
+    ThreadedOp *threadedPages;	// block engine translation of mainMemory
+    bool threadedValid[NumPhysPages]; // same, for threadedPages
+    bool runBlocks;		// use RunBlock instead of OneInstruction
+    int pendingTicks;		// user instructions run in the current
+				// batch, whose time is not charged yet
+
+    int tlbWays;		// entries per TLB set
+    int tlbSets;		// number of TLB sets
+    int tlbValid;		// number of valid TLB entries
+    int tlbHash[TLBHashSize];	// fully associative TLB: first slot of
+				// each bucket, -1 if empty
+    int tlbNext[TLBSize];	// next slot in the same bucket
+    int currentAsid;		// ASID of the translations in use
+    int fetchPage, fetchFrame;	// direct mapped TLB: translation of the
+				// last instruction fetch (-1 if none)
+    bool useShortcuts;		// remember the last code and data pages?
+    int codePage, dataPage;	// virtual page of the last fetch and the
+				// last data access, -1 if none
+    TranslationEntry *codeEntry, *dataEntry;
+				// TLB entries that translated them
+    ExceptionType TranslateEntry(int virtAddr, int* physAddr, int size,
+				 bool writing, TranslationEntry **entryPtr);
+				// Translate, without the shortcuts
+    unsigned TLBKey(int vpn, int asid)	// picks the set and bucket
+	{ return (unsigned) vpn + (unsigned) asid * 11; }
+    void UnhashTLBEntry(int slot);
+    void DropTLBEntry(int slot);
+
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
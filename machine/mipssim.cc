@@ -25,25 +25,72 @@ static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 //
 //	This routine is re-entrant, in that it can be called multiple
 //	times concurrently -- one for each thread executing user code.
+//
+//	Unless single stepping, or tracing instructions or interrupts,
+//	the clock is not advanced after every instruction: we run the
+//	instructions that fit before the next pending interrupt is due
+//	(see RunBatch), and then charge them all at once.
 //----------------------------------------------------------------------
 
 void
 Machine::Run()
 {
     Instruction *instr = new Instruction;  // storage for decoded instruction
+    bool batch = !singleStep && !DebugIsEnabled('m') && !DebugIsEnabled('i');
 
     if(DebugIsEnabled('m'))
         printf("Starting thread \"%s\" at time %d\n",
 	       currentThread->getName(), stats->totalTicks);
     interrupt->setStatus(UserMode);
     for (;;) {
-        OneInstruction(instr);
-	interrupt->OneTick();
+	if (batch)
+	    RunBatch(instr);
+	else {
+	    OneInstruction(instr);
+	    interrupt->OneTick();
+	}
 	if (singleStep && (runUntilTime <= stats->totalTicks))
 	  Debugger();
     }
 }
 
+//----------------------------------------------------------------------
+// Machine::RunBatch
+// 	Run user instructions until the earliest pending interrupt is due,
+//	or until one of them traps to the kernel, and then advance the
+//	clock for all of them.  Simulated time is the same as calling
+//	OneTick after each instruction: nothing can fire before the
+//	deadline, and RaiseException charges the instructions run so far
+//	before entering the kernel.
+//
+//	A trap always ends the batch, since the kernel may schedule new
+//	interrupts or switch to another thread.  "pendingTicks" is back
+//	to 0 whenever a thread can be switched out, so it can be kept in
+//	the machine.
+//----------------------------------------------------------------------
+
+void
+Machine::RunBatch(Instruction *instr)
+{
+    int budget = (interrupt->Deadline() - stats->totalTicks + UserTick - 1)
+			/ UserTick;
+    int ticks;
+    bool ok = true;
+
+    if (budget < 1)
+	budget = 1;
+    while (ok && pendingTicks < budget) {
+	if (runBlocks)
+	    ok = RunBlock(instr, budget - pendingTicks);
+	else {
+	    ok = OneInstruction(instr);
+	    pendingTicks++;
+	}
+    }
+    ticks = pendingTicks;
+    pendingTicks = 0;
+    interrupt->OneTick(ticks);
+}
 
 //----------------------------------------------------------------------
 // TypeToReg
@@ -69,7 +116,8 @@ TypeToReg(RegType reg, Instruction *instr)
 
 //----------------------------------------------------------------------
 // Machine::OneInstruction
-// 	Execute one instruction from a user-level program
+// 	Execute one instruction from a user-level program.  Returns
+//	false if it trapped to the kernel.
 //
 // 	If there is any kind of exception or interrupt, we invoke the 
 //	exception handler, and when it returns, we return to Run(), which
@@ -90,20 +138,39 @@ TypeToReg(RegType reg, Instruction *instr)
 //	and the register set.
 //----------------------------------------------------------------------
 
-void
+bool
 Machine::OneInstruction(Instruction *instr)
 {
-    int raw;
+    int physAddr;
+    ExceptionType exception;
+
+    // Fetch instruction.  The translation is still done on every fetch,
+    // so the TLB, the use bits and page faults behave as before, but
+    // the decoding comes from the per-page cache.
+    exception = TranslateFetch(registers[PCReg], &physAddr);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
+	return false;		// exception occurred
+    }
+    *instr = *DecodedAt(physAddr);
+    return Execute(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::Execute
+// 	Execute an instruction already fetched from the user program at
+//	the PC, and advance the program counters.  Shared by
+//	OneInstruction and by RunBlock, for the instructions the block
+//	engine leaves to the interpreter.
+//----------------------------------------------------------------------
+
+bool
+Machine::Execute(Instruction *instr)
+{
     int nextLoadReg = 0; 	
     int nextLoadValue = 0; 	// record delayed load operation, to apply
 				// in the future
 
-    // Fetch instruction 
-    if (!machine->ReadMem(registers[PCReg], 4, &raw))
-	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
-
     if (DebugIsEnabled('m')) {
        struct OpString *str = &opStrings[(int)instr->opCode];
 
@@ -127,7 +194,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[(int)instr->rs] ^ registers[(int)instr->rt]) & SIGN_BIT) &&
 	    ((registers[(int)instr->rs] ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return false;
 	}
 	registers[(int)instr->rd] = sum;
 	break;
@@ -137,7 +204,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[(int)instr->rs] ^ instr->extra) & SIGN_BIT) &&
 	    ((instr->extra ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return false;
 	}
 	registers[(int)instr->rt] = sum;
 	break;
@@ -232,7 +299,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_LBU:
 	tmp = registers[(int)instr->rs] + instr->extra;
 	if (!machine->ReadMem(tmp, 1, &value))
-	    return;
+	    return false;
 
 	if ((value & 0x80) && (instr->opCode == OP_LB))
 	    value |= 0xffffff00;
@@ -247,10 +314,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[(int)instr->rs] + instr->extra;
 	if (tmp & 0x1) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return false;
 	}
 	if (!machine->ReadMem(tmp, 2, &value))
-	    return;
+	    return false;
 
 	if ((value & 0x8000) && (instr->opCode == OP_LH))
 	    value |= 0xffff0000;
@@ -269,10 +336,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[(int)instr->rs] + instr->extra;
 	if (tmp & 0x3) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return false;
 	}
 	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	    return false;
 	nextLoadReg = instr->rt;
 	nextLoadValue = value;
 	break;
@@ -286,7 +353,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	    return false;
 	if (registers[LoadReg] == instr->rt)
 	    nextLoadValue = registers[LoadValueReg];
 	else
@@ -317,7 +384,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	    return false;
 	if (registers[LoadReg] == instr->rt)
 	    nextLoadValue = registers[LoadValueReg];
 	else
@@ -373,7 +440,7 @@ Machine::OneInstruction(Instruction *instr)
 	break;
 	
       case OP_OR:
-	registers[(int)instr->rd] = registers[(int)instr->rs] | registers[(int)instr->rs];
+	registers[(int)instr->rd] = registers[(int)instr->rs] | registers[(int)instr->rt];
 	break;
 	
       case OP_ORI:
@@ -383,13 +450,13 @@ Machine::OneInstruction(Instruction *instr)
       case OP_SB:
 	if (!machine->WriteMem((unsigned) 
 		(registers[(int)instr->rs] + instr->extra), 1, registers[(int)instr->rt]))
-	    return;
+	    return false;
 	break;
 	
       case OP_SH:
 	if (!machine->WriteMem((unsigned) 
 		(registers[(int)instr->rs] + instr->extra), 2, registers[(int)instr->rt]))
-	    return;
+	    return false;
 	break;
 	
       case OP_SLL:
@@ -459,7 +526,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (((registers[(int)instr->rs] ^ registers[(int)instr->rt]) & SIGN_BIT) &&
 	    ((registers[(int)instr->rs] ^ diff) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return false;
 	}
 	registers[(int)instr->rd] = diff;
 	break;
@@ -471,7 +538,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_SW:
 	if (!machine->WriteMem((unsigned) 
 		(registers[(int)instr->rs] + instr->extra), 4, registers[(int)instr->rt]))
-	    return;
+	    return false;
 	break;
 	
       case OP_SWL:	  
@@ -482,7 +549,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
+	    return false;
 	switch (tmp & 0x3) {
 	  case 0:
 	    value = registers[(int)instr->rt];
@@ -501,7 +568,7 @@ Machine::OneInstruction(Instruction *instr)
 	    break;
 	}
 	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
+	    return false;
 	break;
     	
       case OP_SWR:	  
@@ -512,7 +579,7 @@ Machine::OneInstruction(Instruction *instr)
 	ASSERT((tmp & 0x3) == 0);  
 
 	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
+	    return false;
 	switch (tmp & 0x3) {
 	  case 0:
 	    value = (value & 0xffffff) | (registers[(int)instr->rt] << 24);
@@ -528,12 +595,12 @@ Machine::OneInstruction(Instruction *instr)
 	    break;
 	}
 	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
+	    return false;
 	break;
     	
       case OP_SYSCALL:
 	RaiseException(SyscallException, 0);
-	return; 
+	return false; 
 	
       case OP_XOR:
 	registers[(int)instr->rd] = registers[(int)instr->rs] ^ registers[(int)instr->rt];
@@ -546,7 +613,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_RES:
       case OP_UNIMP:
 	RaiseException(IllegalInstrException, 0);
-	return;
+	return false;
 	
       default:
 	ASSERT(false);
@@ -562,6 +629,7 @@ Machine::OneInstruction(Instruction *instr)
 						// are jumping into lala-land
     registers[PCReg] = registers[NextPCReg];
     registers[NextPCReg] = pcAfter;
+    return true;
 }
 
 //----------------------------------------------------------------------
@@ -581,6 +649,854 @@ Machine::DelayedLoad(int nextReg, int nextValue)
     registers[0] = 0; 	// and always make sure R0 stays zero.
 }
 
+//----------------------------------------------------------------------
+// Machine::DecodedAt
+// 	Return the decoded form of the instruction stored at physical
+//	address "physAddr".  The first fetch from a physical page decodes
+//	the whole page; later fetches just index into the cache, until
+//	the page is invalidated.
+//----------------------------------------------------------------------
+
+Instruction *
+Machine::DecodedAt(int physAddr)
+{
+    int frame = physAddr / PageSize;
+    Instruction *page = &decodedPages[frame * InstrsPerPage];
+
+    if (!decodedValid[frame]) {
+	unsigned int *words = (unsigned int *) &mainMemory[frame * PageSize];
+
+	for (int i = 0; i < InstrsPerPage; i++) {
+	    page[i].value = WordToHost(words[i]);
+	    page[i].Decode();
+	}
+	decodedValid[frame] = true;
+    }
+    return &page[(physAddr % PageSize) / 4];
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecodedPage
+// 	The contents of physical page "frame" are changing (a user store,
+//	the page being loaded, swapped or handed to another address
+//	space), so its pre-decoded instructions can't be trusted anymore.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateDecodedPage(int frame)
+{
+    ASSERT((frame >= 0) && (frame < NumPhysPages));
+    decodedValid[frame] = false;
+    threadedValid[frame] = false;
+}
+
+//----------------------------------------------------------------------
+// Block execution engine
+//
+//	Each physical page of code is translated once into an array of
+//	ThreadedOp's, one per instruction, each holding a pointer to the
+//	routine below that runs that particular operation with its
+//	operands already extracted.  Machine::RunBlock then runs a whole
+//	straight-line block by calling these routines one after the other,
+//	without going through the fetch/decode/switch of OneInstruction.
+//
+//	Every routine must leave the machine exactly as Execute would:
+//	operands are read before the pending delayed load is applied, and
+//	the program counters advance the same way, so the load delay and
+//	the branch delay slot behave as in the interpreter.  If the
+//	instruction traps, the routine returns false after RaiseException,
+//	without touching the registers again.
+//
+//	Instructions that are rare or awkward (partial word loads and
+//	stores, syscalls, illegal instructions) have no routine, and are
+//	left to the interpreter.
+//----------------------------------------------------------------------
+
+// Apply the pending delayed load, record the new one, and advance the
+// program counters; "pcAfter" is the next value of NextPCReg.
+static inline bool
+Retire(int *r, int nextLoadReg, int nextLoadValue, int pcAfter)
+{
+    r[r[LoadReg]] = r[LoadValueReg];
+    r[LoadReg] = nextLoadReg;
+    r[LoadValueReg] = nextLoadValue;
+    r[0] = 0;
+    r[PrevPCReg] = r[PCReg];
+    r[PCReg] = r[NextPCReg];
+    r[NextPCReg] = pcAfter;
+    return true;
+}
+
+static inline bool
+Next(int *r)
+{
+    return Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static inline bool
+Load(int *r, int reg, int value)
+{
+    return Retire(r, reg, value, r[NextPCReg] + 4);
+}
+
+static inline bool
+Jump(int *r, int target)
+{
+    return Retire(r, 0, 0, target);
+}
+
+static bool
+DoADD(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int sum = r[op->rs] + r[op->rt];
+
+    if (!((r[op->rs] ^ r[op->rt]) & SIGN_BIT) && ((r[op->rs] ^ sum) & SIGN_BIT)) {
+	m->RaiseException(OverflowException, 0);
+	return false;
+    }
+    r[op->rd] = sum;
+    return Next(r);
+}
+
+static bool
+DoADDI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int sum = r[op->rs] + op->extra;
+
+    if (!((r[op->rs] ^ op->extra) & SIGN_BIT) && ((op->extra ^ sum) & SIGN_BIT)) {
+	m->RaiseException(OverflowException, 0);
+	return false;
+    }
+    r[op->rt] = sum;
+    return Next(r);
+}
+
+static bool
+DoADDIU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rt] = r[op->rs] + op->extra;
+    return Next(r);
+}
+
+static bool
+DoADDU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rs] + r[op->rt];
+    return Next(r);
+}
+
+static bool
+DoAND(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rs] & r[op->rt];
+    return Next(r);
+}
+
+// ANDI, ORI and XORI have their immediate zero-extended at translation
+static bool
+DoANDI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rt] = r[op->rs] & op->extra;
+    return Next(r);
+}
+
+// Branch offsets are converted to bytes at translation
+static bool
+DoBEQ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (r[op->rs] == r[op->rt])
+	return Jump(r, r[NextPCReg] + op->extra);
+    return Next(r);
+}
+
+static bool
+DoBGEZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (!(r[op->rs] & SIGN_BIT))
+	return Jump(r, r[NextPCReg] + op->extra);
+    return Next(r);
+}
+
+static bool
+DoBGEZAL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[R31] = r[NextPCReg] + 4;
+    return DoBGEZ(m, op);
+}
+
+static bool
+DoBGTZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (r[op->rs] > 0)
+	return Jump(r, r[NextPCReg] + op->extra);
+    return Next(r);
+}
+
+static bool
+DoBLEZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (r[op->rs] <= 0)
+	return Jump(r, r[NextPCReg] + op->extra);
+    return Next(r);
+}
+
+static bool
+DoBLTZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (r[op->rs] & SIGN_BIT)
+	return Jump(r, r[NextPCReg] + op->extra);
+    return Next(r);
+}
+
+static bool
+DoBLTZAL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[R31] = r[NextPCReg] + 4;
+    return DoBLTZ(m, op);
+}
+
+static bool
+DoBNE(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (r[op->rs] != r[op->rt])
+	return Jump(r, r[NextPCReg] + op->extra);
+    return Next(r);
+}
+
+static bool
+DoDIV(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (r[op->rt] == 0) {
+	r[LoReg] = 0;
+	r[HiReg] = 0;
+    } else {
+	r[LoReg] = r[op->rs] / r[op->rt];
+	r[HiReg] = r[op->rs] % r[op->rt];
+    }
+    return Next(r);
+}
+
+static bool
+DoDIVU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    unsigned int rs = (unsigned int) r[op->rs];
+    unsigned int rt = (unsigned int) r[op->rt];
+
+    if (rt == 0) {
+	r[LoReg] = 0;
+	r[HiReg] = 0;
+    } else {
+	r[LoReg] = (int) (rs / rt);
+	r[HiReg] = (int) (rs % rt);
+    }
+    return Next(r);
+}
+
+// Jump targets are converted to bytes at translation
+static bool
+DoJ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    return Jump(r, ((r[NextPCReg] + 4) & 0xf0000000) | op->extra);
+}
+
+static bool
+DoJAL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[R31] = r[NextPCReg] + 4;
+    return DoJ(m, op);
+}
+
+static bool
+DoJR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    return Jump(r, r[op->rs]);
+}
+
+static bool
+DoJALR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[NextPCReg] + 4;
+    return DoJR(m, op);
+}
+
+static bool
+DoLB(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int value;
+
+    if (!m->ReadMem(r[op->rs] + op->extra, 1, &value))
+	return false;
+    if (value & 0x80)
+	value |= 0xffffff00;
+    else
+	value &= 0xff;
+    return Load(r, op->rt, value);
+}
+
+static bool
+DoLBU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int value;
+
+    if (!m->ReadMem(r[op->rs] + op->extra, 1, &value))
+	return false;
+    return Load(r, op->rt, value & 0xff);
+}
+
+static bool
+DoLH(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int addr = r[op->rs] + op->extra;
+    int value;
+
+    if (addr & 0x1) {
+	m->RaiseException(AddressErrorException, addr);
+	return false;
+    }
+    if (!m->ReadMem(addr, 2, &value))
+	return false;
+    if (value & 0x8000)
+	value |= 0xffff0000;
+    else
+	value &= 0xffff;
+    return Load(r, op->rt, value);
+}
+
+static bool
+DoLHU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int addr = r[op->rs] + op->extra;
+    int value;
+
+    if (addr & 0x1) {
+	m->RaiseException(AddressErrorException, addr);
+	return false;
+    }
+    if (!m->ReadMem(addr, 2, &value))
+	return false;
+    return Load(r, op->rt, value & 0xffff);
+}
+
+// The immediate is shifted into the upper half at translation
+static bool
+DoLUI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rt] = op->extra;
+    return Next(r);
+}
+
+static bool
+DoLW(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int addr = r[op->rs] + op->extra;
+    int value;
+
+    if (addr & 0x3) {
+	m->RaiseException(AddressErrorException, addr);
+	return false;
+    }
+    if (!m->ReadMem(addr, 4, &value))
+	return false;
+    return Load(r, op->rt, value);
+}
+
+static bool
+DoMFHI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[HiReg];
+    return Next(r);
+}
+
+static bool
+DoMFLO(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[LoReg];
+    return Next(r);
+}
+
+static bool
+DoMTHI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[HiReg] = r[op->rs];
+    return Next(r);
+}
+
+static bool
+DoMTLO(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[LoReg] = r[op->rs];
+    return Next(r);
+}
+
+static bool
+DoMULT(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    Mult(r[op->rs], r[op->rt], true, &r[HiReg], &r[LoReg]);
+    return Next(r);
+}
+
+static bool
+DoMULTU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    Mult(r[op->rs], r[op->rt], false, &r[HiReg], &r[LoReg]);
+    return Next(r);
+}
+
+static bool
+DoNOR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = ~(r[op->rs] | r[op->rt]);
+    return Next(r);
+}
+
+static bool
+DoOR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rs] | r[op->rt];
+    return Next(r);
+}
+
+static bool
+DoORI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rt] = r[op->rs] | op->extra;
+    return Next(r);
+}
+
+static bool
+DoSB(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (!m->WriteMem((unsigned) (r[op->rs] + op->extra), 1, r[op->rt]))
+	return false;
+    return Next(r);
+}
+
+static bool
+DoSH(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (!m->WriteMem((unsigned) (r[op->rs] + op->extra), 2, r[op->rt]))
+	return false;
+    return Next(r);
+}
+
+static bool
+DoSLL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rt] << op->extra;
+    return Next(r);
+}
+
+static bool
+DoSLLV(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rt] << (r[op->rs] & 0x1f);
+    return Next(r);
+}
+
+static bool
+DoSLT(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = (r[op->rs] < r[op->rt]) ? 1 : 0;
+    return Next(r);
+}
+
+static bool
+DoSLTI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rt] = (r[op->rs] < op->extra) ? 1 : 0;
+    return Next(r);
+}
+
+static bool
+DoSLTIU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rt] = ((unsigned int) r[op->rs] < (unsigned int) op->extra) ? 1 : 0;
+    return Next(r);
+}
+
+static bool
+DoSLTU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = ((unsigned int) r[op->rs] < (unsigned int) r[op->rt]) ? 1 : 0;
+    return Next(r);
+}
+
+static bool
+DoSRA(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rt] >> op->extra;
+    return Next(r);
+}
+
+static bool
+DoSRAV(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rt] >> (r[op->rs] & 0x1f);
+    return Next(r);
+}
+
+// Like the interpreter, which shifts an int, so SRL is arithmetic too
+static bool
+DoSRL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rt] >> op->extra;
+    return Next(r);
+}
+
+static bool
+DoSRLV(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rt] >> (r[op->rs] & 0x1f);
+    return Next(r);
+}
+
+static bool
+DoSUB(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int diff = r[op->rs] - r[op->rt];
+
+    if (((r[op->rs] ^ r[op->rt]) & SIGN_BIT) && ((r[op->rs] ^ diff) & SIGN_BIT)) {
+	m->RaiseException(OverflowException, 0);
+	return false;
+    }
+    r[op->rd] = diff;
+    return Next(r);
+}
+
+static bool
+DoSUBU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rs] - r[op->rt];
+    return Next(r);
+}
+
+static bool
+DoSW(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (!m->WriteMem((unsigned) (r[op->rs] + op->extra), 4, r[op->rt]))
+	return false;
+    return Next(r);
+}
+
+static bool
+DoXOR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rd] = r[op->rs] ^ r[op->rt];
+    return Next(r);
+}
+
+static bool
+DoXORI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    r[op->rt] = r[op->rs] ^ op->extra;
+    return Next(r);
+}
+
+//----------------------------------------------------------------------
+// TranslateOp
+// 	Fill in "op" for the decoded instruction "instr": pick its routine
+//	and pre-compute its immediate.  Returns whether the instruction
+//	ends a basic block (a branch or jump, so it must be followed by
+//	its delay slot).  Instructions left to the interpreter get a NULL
+//	routine.
+//----------------------------------------------------------------------
+
+static bool
+TranslateOp(Instruction *instr, ThreadedOp *op)
+{
+    op->rs = instr->rs;
+    op->rt = instr->rt;
+    op->rd = instr->rd;
+    op->extra = instr->extra;
+    op->run = NULL;
+    switch (instr->opCode) {
+      case OP_ADD:	op->run = DoADD; break;
+      case OP_ADDI:	op->run = DoADDI; break;
+      case OP_ADDIU:	op->run = DoADDIU; break;
+      case OP_ADDU:	op->run = DoADDU; break;
+      case OP_AND:	op->run = DoAND; break;
+      case OP_DIV:	op->run = DoDIV; break;
+      case OP_DIVU:	op->run = DoDIVU; break;
+      case OP_LB:	op->run = DoLB; break;
+      case OP_LBU:	op->run = DoLBU; break;
+      case OP_LH:	op->run = DoLH; break;
+      case OP_LHU:	op->run = DoLHU; break;
+      case OP_LW:	op->run = DoLW; break;
+      case OP_MFHI:	op->run = DoMFHI; break;
+      case OP_MFLO:	op->run = DoMFLO; break;
+      case OP_MTHI:	op->run = DoMTHI; break;
+      case OP_MTLO:	op->run = DoMTLO; break;
+      case OP_MULT:	op->run = DoMULT; break;
+      case OP_MULTU:	op->run = DoMULTU; break;
+      case OP_NOR:	op->run = DoNOR; break;
+      case OP_OR:	op->run = DoOR; break;
+      case OP_SB:	op->run = DoSB; break;
+      case OP_SH:	op->run = DoSH; break;
+      case OP_SLL:	op->run = DoSLL; break;
+      case OP_SLLV:	op->run = DoSLLV; break;
+      case OP_SLT:	op->run = DoSLT; break;
+      case OP_SLTI:	op->run = DoSLTI; break;
+      case OP_SLTIU:	op->run = DoSLTIU; break;
+      case OP_SLTU:	op->run = DoSLTU; break;
+      case OP_SRA:	op->run = DoSRA; break;
+      case OP_SRAV:	op->run = DoSRAV; break;
+      case OP_SRL:	op->run = DoSRL; break;
+      case OP_SRLV:	op->run = DoSRLV; break;
+      case OP_SUB:	op->run = DoSUB; break;
+      case OP_SUBU:	op->run = DoSUBU; break;
+      case OP_SW:	op->run = DoSW; break;
+      case OP_XOR:	op->run = DoXOR; break;
+
+      case OP_ANDI:
+	op->run = DoANDI;
+	op->extra &= 0xffff;
+	break;
+      case OP_ORI:
+	op->run = DoORI;
+	op->extra &= 0xffff;
+	break;
+      case OP_XORI:
+	op->run = DoXORI;
+	op->extra &= 0xffff;
+	break;
+      case OP_LUI:
+	op->run = DoLUI;
+	op->extra <<= 16;
+	break;
+
+      case OP_BEQ:	op->run = DoBEQ; break;
+      case OP_BGEZ:	op->run = DoBGEZ; break;
+      case OP_BGEZAL:	op->run = DoBGEZAL; break;
+      case OP_BGTZ:	op->run = DoBGTZ; break;
+      case OP_BLEZ:	op->run = DoBLEZ; break;
+      case OP_BLTZ:	op->run = DoBLTZ; break;
+      case OP_BLTZAL:	op->run = DoBLTZAL; break;
+      case OP_BNE:	op->run = DoBNE; break;
+      case OP_J:	op->run = DoJ; break;
+      case OP_JAL:	op->run = DoJAL; break;
+      case OP_JR:	op->run = DoJR; break;
+      case OP_JALR:	op->run = DoJALR; break;
+
+      default:			// LWL, LWR, SWL, SWR, SYSCALL, RES, UNIMP
+	return false;
+    }
+    switch (instr->opCode) {
+      case OP_BEQ: case OP_BGEZ: case OP_BGEZAL: case OP_BGTZ:
+      case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL: case OP_BNE:
+	op->extra = IndexToAddr(op->extra);
+	return true;
+      case OP_J: case OP_JAL:
+	op->extra = IndexToAddr(op->extra);
+	return true;
+      case OP_JR: case OP_JALR:
+	return true;
+      default:
+	return false;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::ThreadedAt
+// 	Return the block engine translation of the instruction stored at
+//	physical address "physAddr", translating its page if needed.
+//
+//	The length of the block starting at each instruction is computed
+//	backwards from the end of the page: a block runs up to the first
+//	branch or jump, plus its delay slot, and stops before any
+//	instruction left to the interpreter or at the end of the page.
+//----------------------------------------------------------------------
+
+ThreadedOp *
+Machine::ThreadedAt(int physAddr)
+{
+    int frame = physAddr / PageSize;
+    ThreadedOp *page = &threadedPages[frame * InstrsPerPage];
+
+    if (!threadedValid[frame]) {
+	Instruction *decoded = DecodedAt(frame * PageSize);
+	bool endsBlock[InstrsPerPage];
+	int i;
+
+	for (i = 0; i < InstrsPerPage; i++)
+	    endsBlock[i] = TranslateOp(&decoded[i], &page[i]);
+	for (i = InstrsPerPage - 1; i >= 0; i--) {
+	    bool last = (i == InstrsPerPage - 1);
+
+	    if (page[i].run == NULL)
+		page[i].count = 0;
+	    else if (endsBlock[i])	// needs a plain delay slot
+		page[i].count = (!last && page[i + 1].run != NULL
+				 && !endsBlock[i + 1]) ? 2 : 0;
+	    else if (last || page[i + 1].count == 0)
+		page[i].count = 1;
+	    else
+		page[i].count = 1 + page[i + 1].count;
+	}
+	threadedValid[frame] = true;
+    }
+    return &page[(physAddr % PageSize) / 4];
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Run the basic block of user instructions starting at the PC,
+//	through the block engine, but no more than "limit" instructions.
+//	Each instruction executed (including one that traps) is added to
+//	"pendingTicks", for RunBatch to charge.  Returns false if an
+//	instruction trapped to the kernel.
+//
+//	The PC is translated once for the whole block, which never leaves
+//	its page; the TLB hits the other fetches would have scored are
+//	added to the statistics.  Data accesses are translated as usual.
+//	The block ends early if an instruction traps, or if it writes on
+//	the page being run.
+//
+//	A block never starts in a delay slot: there, and for the
+//	instructions the engine does not handle, we fall back on Execute.
+//----------------------------------------------------------------------
+
+bool
+Machine::RunBlock(Instruction *instr, int limit)
+{
+    int physAddr, frame, count, n;
+    ExceptionType exception;
+    ThreadedOp *op;
+    bool ok = true, fetchHits;
+
+    if (registers[NextPCReg] != registers[PCReg] + 4) {
+	ok = OneInstruction(instr);
+	pendingTicks++;
+	return ok;
+    }
+    exception = TranslateFetch(registers[PCReg], &physAddr);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
+	pendingTicks++;
+	return false;
+    }
+    op = ThreadedAt(physAddr);
+    count = op->count;
+    if (count == 0) {
+	*instr = *DecodedAt(physAddr);
+	ok = Execute(instr);
+	pendingTicks++;
+	return ok;
+    }
+    if (count > limit)
+	count = limit;
+
+    frame = physAddr / PageSize;
+    fetchHits = (tlb != NULL) && (LookupTLB(registers[PCReg] / PageSize) >= 0);
+    for (n = 0; n < count; ) {
+	ok = (*op->run)(this, op);
+	pendingTicks++;
+	n++;
+	op++;
+	if (!ok || !threadedValid[frame])
+	    break;
+    }
+    if (fetchHits) {
+	stats->numTLBHits += n - 1;
+	stats->asidTLBHits[currentAsid] += n - 1;
+    }
+    return ok;
+}
+
 //----------------------------------------------------------------------
 // Instruction::Decode
 // 	Decode a MIPS instruction 
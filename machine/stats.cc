@@ -23,7 +23,17 @@ Statistics::Statistics()
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
 #ifdef USE_TLB
-    numTLBHits = 0;
+    numTLBHits = numTLBMisses = numTLBConflicts = 0;
+    tlbWays = tlbSets = 0;
+    tlbReplacement = NULL;
+    for (int i = 0; i < NumASIDs; i++)
+	asidTLBHits[i] = asidTLBMisses[i] = 0;
+#endif
+#ifdef VM
+    replacement = NULL;
+    numPageIns = numEvictions = numPageOuts = numPagerEvictions = 0;
+    numPageReclaims = numReadAheads = 0;
+    numLocalEvictions = numSuspensions = 0;
 #endif
 #ifdef DFS_TICKS_FIX
     numBugFix = 0;
@@ -50,9 +60,32 @@ Statistics::Print()
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	            numConsoleCharsWritten);
     printf("Paging: faults %d\n", numPageFaults);
+#ifdef VM
+    printf("Replacement: %s, page-ins %d (%d read ahead), evictions %d "
+	"(%d by the pager), write-backs %d, reclaims %d\n", replacement,
+	numPageIns, numReadAheads, numEvictions, numPagerEvictions,
+	numPageOuts, numPageReclaims);
+    printf("Resident sets: local evictions %d, suspensions %d\n",
+	numLocalEvictions, numSuspensions);
+#endif
 #ifdef USE_TLB
+    if (tlbSets == 1)
+	printf("TLB: fully associative, %d entries", tlbWays);
+    else if (tlbWays == 1)
+	printf("TLB: direct mapped, %d entries", tlbSets);
+    else
+	printf("TLB: %d-way set associative, %d sets", tlbWays, tlbSets);
+    if (tlbReplacement != NULL)
+	printf(", %s replacement", tlbReplacement);
+    printf("\n");
     printf("TLB Hits: %d\n", numTLBHits);
     printf("TLB Hit Ratio: %f\n", numTLBHits / double(numTLBHits+numPageFaults));
+    printf("TLB Misses: %d, conflicts %d\n", numTLBMisses, numTLBConflicts);
+    for (int i = 0; i < NumASIDs; i++)
+	if (asidTLBHits[i] + asidTLBMisses[i] > 0)
+	    printf("  ASID %d: hits %d, misses %d, hit ratio %f\n", i,
+		asidTLBHits[i], asidTLBMisses[i],
+		asidTLBHits[i] / double(asidTLBHits[i] + asidTLBMisses[i]));
 #endif
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
@@ -12,6 +12,7 @@
 #define STATS_H
 
 #include "copyright.h"
+#include "translate.h"
 
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
@@ -34,6 +35,24 @@ class Statistics {
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
     int numTLBHits;         // number of TLB hits
+    int numTLBMisses;		// number of TLB misses
+    int numTLBConflicts;	// valid TLB entries replaced while others
+				// were free (see Machine::LoadTLBEntry)
+    int tlbWays, tlbSets;	// organization of the TLB
+    const char *tlbReplacement;	// TLB replacement policy in use
+    int asidTLBHits[NumASIDs];	// TLB hits and misses of each address
+    int asidTLBMisses[NumASIDs]; // space identifier
+    const char *replacement;	// page replacement policy in use
+    int numPageIns;		// pages read in, from swap or the executable
+    int numEvictions;		// frames taken away from a page to reuse them
+    int numPageOuts;		// pages written back to swap
+    int numPagerEvictions;	// evictions done ahead by the pager thread
+    int numPageReclaims;	// faults served by a frame the pager freed,
+				// that still held the page
+    int numReadAheads;		// pages read in along with a faulting one
+    int numLocalEvictions;	// pages evicted to keep a process within
+				// its resident set
+    int numSuspensions;		// processes suspended for lack of frames
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 #ifdef DFS_TICKS_FIX
@@ -34,6 +34,7 @@ extern "C" {
 #include <sys/file.h>
 #include <sys/un.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #ifdef HOST_i386
 #include <sys/time.h>
 #endif
@@ -198,6 +199,22 @@ Tell(int fd)
 }
 
 
+//----------------------------------------------------------------------
+// FileIdentity
+// 	Return a number that tells the open file apart from any other
+//	file (its inode).  Abort on error.
+//----------------------------------------------------------------------
+
+int 
+FileIdentity(int fd)
+{
+    struct stat info;
+    int retVal = fstat(fd, &info);
+
+    ASSERT(retVal == 0);
+    return (int) info.st_ino;
+}
+
 //----------------------------------------------------------------------
 // Close
 // 	Close a file.  Abort on error.
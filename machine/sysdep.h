@@ -26,6 +26,7 @@ extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, const char *buffer, int nBytes);
 extern void Lseek(int fd, int offset, int whence);
 extern int Tell(int fd);
+extern int FileIdentity(int fd);
 extern int Close(int fd);
 extern bool Unlink(const char *name);
 
@@ -21,7 +21,8 @@
 //	anything at all about that.
 //
 //	Note that the contents of the TLB are specific to an address space.
-//	If the address space changes, so does the contents of the TLB!
+//	Each entry is tagged with the ASID of its address space, so the
+//	entries of several address spaces can share the TLB.
 //
 // DO NOT CHANGE -- part of the machine emulation
 //
@@ -147,6 +148,8 @@ Machine::WriteMem(int addr, int size, int value)
 	machine->RaiseException(exception, addr);
 	return false;
     }
+    decodedValid[physicalAddress / PageSize] = false;	// code may change
+    threadedValid[physicalAddress / PageSize] = false;
     switch (size) {
       case 1:
 	machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
@@ -170,6 +173,104 @@ Machine::WriteMem(int addr, int size, int value)
 
 //----------------------------------------------------------------------
 // Machine::Translate
+// 	Translate a virtual address into a physical address, for a data
+//	access of the user program (or the kernel on its behalf).  Check
+//	for alignment and all sorts of other errors, and if everything is
+//	ok, set the use/dirty bits in the translation table entry, and
+//	store the translated physical address in "physAddr".  If there
+//	was an error, returns the type of the exception.
+//
+//	With a TLB, the machine remembers which TLB entry translated the
+//	last data page, and goes straight to it while accesses stay in
+//	that page (as they almost always do).  The use and dirty bits,
+//	the read-only check and the statistics are the same as with the
+//	full lookup.  The shortcut is dropped as soon as its TLB entry is
+//	replaced or invalidated (which covers SwapOut), or the ASID
+//	changes.
+//
+//	"virtAddr" -- the virtual address to translate
+//	"physAddr" -- the place to store the physical address
+//	"size" -- the amount of memory being read or written
+// 	"writing" -- if true, check the "read-only" bit in the TLB
+//----------------------------------------------------------------------
+
+ExceptionType
+Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
+{
+    int vpn = (unsigned) virtAddr / PageSize;
+    TranslationEntry *entry;
+    ExceptionType exception;
+
+    if ((vpn == dataPage) && !(virtAddr & (size - 1))
+	&& !(writing && dataEntry->readOnly)) {
+	dataEntry->use = true;
+	if (writing)
+	    dataEntry->dirty = true;
+	stats->numTLBHits++;
+	stats->asidTLBHits[currentAsid]++;
+	*physAddr = dataEntry->physicalPage * PageSize
+			+ (unsigned) virtAddr % PageSize;
+	return NoException;
+    }
+    exception = TranslateEntry(virtAddr, physAddr, size, writing, &entry);
+    if ((exception == NoException) && (tlb != NULL) && useShortcuts) {
+	dataPage = vpn;
+	dataEntry = entry;
+    }
+    return exception;
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslateFetch
+// 	Translate the address of the instruction to fetch.  Like
+//	Translate, but with its own shortcut, since the code page is
+//	usually not the data page.
+//
+//	A direct mapped TLB cannot hold at the same time the code page
+//	and the data page of an instruction when both map to the same
+//	slot: refilling one throws out the other, and the instruction
+//	would fault forever.  So, like the instruction micro-TLB of some
+//	MIPS processors, the machine keeps a copy of the translation of
+//	the last fetch, and uses it when the fetch misses in the TLB.
+//	The copy goes away when the kernel invalidates the page, but not
+//	when its TLB entry is just replaced.  (Fetches served by the copy
+//	do not set the use bit, since its TLB entry is gone.)
+//----------------------------------------------------------------------
+
+ExceptionType
+Machine::TranslateFetch(int virtAddr, int* physAddr)
+{
+    int vpn = (unsigned) virtAddr / PageSize;
+    TranslationEntry *entry;
+    ExceptionType exception;
+
+    if ((vpn == codePage) && !(virtAddr & 0x3)) {
+	codeEntry->use = true;
+	stats->numTLBHits++;
+	stats->asidTLBHits[currentAsid]++;
+	*physAddr = codeEntry->physicalPage * PageSize
+			+ (unsigned) virtAddr % PageSize;
+	return NoException;
+    }
+    if ((tlb != NULL) && (tlbWays == 1) && (vpn == fetchPage)
+	&& !(virtAddr & 0x3) && (LookupTLB(vpn) < 0)) {
+	*physAddr = fetchFrame * PageSize + (unsigned) virtAddr % PageSize;
+	return NoException;
+    }
+    exception = TranslateEntry(virtAddr, physAddr, 4, false, &entry);
+    if ((exception == NoException) && (tlb != NULL)) {
+	if (useShortcuts) {
+	    codePage = vpn;
+	    codeEntry = entry;
+	}
+	fetchPage = vpn;
+	fetchFrame = *physAddr / PageSize;
+    }
+    return exception;
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslateEntry
 // 	Translate a virtual address into a physical address, using 
 //	either a page table or a TLB.  Check for alignment and all sorts 
 //	of other errors, and if everything is ok, set the use/dirty bits in 
@@ -177,16 +278,21 @@ Machine::WriteMem(int addr, int size, int value)
 //	address in "physAddr".  If there was an error, returns the type
 //	of the exception.
 //
+//	This is the full translation; data accesses and instruction
+//	fetches first try their shortcut (see Translate, TranslateFetch).
+//
 //	"virtAddr" -- the virtual address to translate
 //	"physAddr" -- the place to store the physical address
 //	"size" -- the amount of memory being read or written
 // 	"writing" -- if true, check the "read-only" bit in the TLB
+//	"entryPtr" -- the place to store the translation entry used
 //----------------------------------------------------------------------
 
 ExceptionType
-Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
+Machine::TranslateEntry(int virtAddr, int* physAddr, int size, bool writing,
+			TranslationEntry **entryPtr)
 {
-    int i;
+    int i = -1;
     unsigned int vpn, offset;
     TranslationEntry *entry;
     unsigned int pageFrame;
@@ -221,19 +327,19 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	}
 	entry = &pageTable[vpn];
     } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && (tlb[i].virtualPage == (int)vpn)) {
-                entry = &tlb[i];			// FOUND!
-		        stats->numTLBHits++;
-                break;
-            }
-    }
-	if (entry == NULL) {				// not found
+	i = LookupTLB(vpn);
+	if (i < 0) {				// not found
     	    DEBUG('n', "*** no valid TLB entry found for this virtual page!\n");
-	        stats->numPageFaults++;
+	    stats->numPageFaults++;
+	    stats->numTLBMisses++;
+	    stats->asidTLBMisses[currentAsid]++;
             return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
+	}
+	entry = &tlb[i];			// FOUND!
+	stats->numTLBHits++;
+	stats->asidTLBHits[currentAsid]++;
     }
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
@@ -256,5 +362,217 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     *physAddr = pageFrame * PageSize + offset;
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
     DEBUG('n', "phys addr = 0x%x\n", *physAddr);
+    *entryPtr = entry;
     return NoException;
 }
+
+//----------------------------------------------------------------------
+// Machine::TLBSetStart
+// 	Return the first slot of the TLB set that virtual page "vpn" maps
+//	to, in the current address space; the page can be loaded in that
+//	slot or any of the following TLBWays() - 1.
+//----------------------------------------------------------------------
+
+int
+Machine::TLBSetStart(int vpn)
+{
+    return (TLBKey(vpn, currentAsid) % tlbSets) * tlbWays;
+}
+
+//----------------------------------------------------------------------
+// Machine::SetASID
+// 	Make "asid" the current address space identifier: from now on,
+//	only the TLB entries loaded with it translate.  The entries of
+//	the other address spaces stay in the TLB, for when they run again.
+//
+//	The shortcuts to the last code and data pages, and the copy of
+//	the last fetch, belong to the old address space, so they go.
+//----------------------------------------------------------------------
+
+void
+Machine::SetASID(int asid)
+{
+    ASSERT((asid >= 0) && (asid < NumASIDs));
+    currentAsid = asid;
+    fetchPage = codePage = dataPage = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::LookupTLB
+// 	Return the slot of the valid TLB entry for virtual page "vpn" of
+//	address space "asid", or -1 if there is none.  Only the ways of
+//	its set are searched; when the TLB is fully associative, the hash
+//	index is used instead.  Does not touch the statistics or the use
+//	bits.
+//----------------------------------------------------------------------
+
+int
+Machine::LookupTLB(int vpn, int asid)
+{
+    unsigned key = TLBKey(vpn, asid);
+    int slot, last;
+
+    if (tlbSets == 1) {
+	for (slot = tlbHash[key % TLBHashSize]; slot != -1;
+	     slot = tlbNext[slot])
+	    if ((tlb[slot].virtualPage == vpn) && (tlb[slot].asid == asid))
+		return slot;
+	return -1;
+    }
+    slot = (key % tlbSets) * tlbWays;
+    for (last = slot + tlbWays; slot < last; slot++)
+	if (tlb[slot].valid && (tlb[slot].virtualPage == vpn)
+	    && (tlb[slot].asid == asid))
+	    return slot;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::LoadTLBEntry
+// 	Load a copy of the translation "entry" into TLB slot "slot",
+//	which must belong to the set of the page.  The entry is tagged
+//	with the current ASID.
+//
+//	Throwing away a valid translation while other slots are free is
+//	counted as a conflict: it is the organization of the TLB, and not
+//	its size, that forces the replacement.
+//----------------------------------------------------------------------
+
+void
+Machine::LoadTLBEntry(int slot, TranslationEntry *entry)
+{
+    int start = TLBSetStart(entry->virtualPage);
+
+    ASSERT((slot >= start) && (slot < start + tlbWays));
+    if (tlb[slot].valid && (tlbValid < TLBSize))
+	stats->numTLBConflicts++;
+    DropTLBEntry(slot);
+    tlb[slot] = *entry;
+    tlb[slot].asid = currentAsid;
+    if (tlb[slot].valid) {
+	tlbValid++;
+	if (tlbSets == 1) {
+	    int bucket = TLBKey(entry->virtualPage, currentAsid) % TLBHashSize;
+
+	    tlbNext[slot] = tlbHash[bucket];
+	    tlbHash[bucket] = slot;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::UpdateTLBEntry
+// 	Give the translation already in TLB slot "slot" the frame and
+//	protection of "entry", a new version of the same page (for
+//	instance, a private copy of a page that was copy-on-write).
+//
+//	The slot stays where it is, in its set and in the hash index, so
+//	this is not a replacement and no conflict is counted; only the
+//	shortcuts that may hold the old frame are forgotten.
+//----------------------------------------------------------------------
+
+void
+Machine::UpdateTLBEntry(int slot, TranslationEntry *entry)
+{
+    ASSERT((slot >= 0) && (slot < TLBSize) && tlb[slot].valid);
+    ASSERT((tlb[slot].virtualPage == entry->virtualPage)
+	   && (tlb[slot].asid == currentAsid));
+    if (&tlb[slot] == codeEntry)
+	codePage = -1;
+    if (&tlb[slot] == dataEntry)
+	dataPage = -1;
+    if (entry->virtualPage == fetchPage)
+	fetchPage = -1;
+    tlb[slot].physicalPage = entry->physicalPage;
+    tlb[slot].readOnly = entry->readOnly;
+    tlb[slot].dirty = entry->dirty;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateTLBEntry
+// 	Invalidate the translation in TLB slot "slot", if any, because
+//	the page is no longer mapped there.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateTLBEntry(int slot)
+{
+    ASSERT((slot >= 0) && (slot < TLBSize));
+    if (tlb[slot].valid && (tlb[slot].virtualPage == fetchPage)
+	&& (tlb[slot].asid == currentAsid))
+	fetchPage = -1;
+    DropTLBEntry(slot);
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateTLBPage
+// 	Invalidate the translation of virtual page "vpn" of address space
+//	"asid" (for instance, because the page is being swapped out),
+//	wherever it is cached.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateTLBPage(int vpn, int asid)
+{
+    int slot = LookupTLB(vpn, asid);
+
+    if (slot >= 0)
+	InvalidateTLBEntry(slot);
+    if ((vpn == fetchPage) && (asid == currentAsid))
+	fetchPage = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTLB
+// 	Invalidate every TLB entry, of every address space.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTLB()
+{
+    for (int i = 0; i < TLBSize; i++)
+	tlb[i].valid = false;
+    for (int i = 0; i < TLBHashSize; i++)
+	tlbHash[i] = -1;
+    tlbValid = 0;
+    fetchPage = codePage = dataPage = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::DropTLBEntry
+// 	Take the entry in TLB slot "slot" out of the TLB, either because
+//	it is replaced or because it is invalidated.
+//----------------------------------------------------------------------
+
+void
+Machine::DropTLBEntry(int slot)
+{
+    if (!tlb[slot].valid)
+	return;
+    if (&tlb[slot] == codeEntry)		// forget the shortcuts too
+	codePage = -1;
+    if (&tlb[slot] == dataEntry)
+	dataPage = -1;
+    if (tlbSets == 1)
+	UnhashTLBEntry(slot);
+    tlb[slot].valid = false;
+    tlbValid--;
+}
+
+//----------------------------------------------------------------------
+// Machine::UnhashTLBEntry
+// 	Take TLB slot "slot" off the chain of its bucket in the hash index.
+//----------------------------------------------------------------------
+
+void
+Machine::UnhashTLBEntry(int slot)
+{
+    int *link = &tlbHash[TLBKey(tlb[slot].virtualPage, tlb[slot].asid)
+			 % TLBHashSize];
+
+    while (*link != slot) {
+	ASSERT(*link != -1);
+	link = &tlbNext[*link];
+    }
+    *link = tlbNext[slot];
+}
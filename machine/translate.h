@@ -21,6 +21,9 @@
 #include "copyright.h"
 #include "utility.h"
 
+const int NumASIDs = 64;	// address space identifiers a TLB entry can
+				// be tagged with
+
 // The following class defines an entry in a translation table -- either
 // in a page table or a TLB.  Each entry defines a mapping from one 
 // virtual page to one physical page.
@@ -40,6 +43,8 @@ class TranslationEntry {
                         // page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
                         // page is modified.
+    int asid;		// TLB only: the address space the translation
+			// belongs to (set by Machine::LoadTLBEntry)
 };
 
 #endif
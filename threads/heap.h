@@ -0,0 +1,368 @@
+// heap.h
+//	Data structure to manage a priority queue of items, kept as a
+//	binary min-heap.
+//
+//	Unlike a sorted List, the items are stored by value, in a single
+//	array that only grows, so inserting or removing an item does not
+//	allocate memory (once the array is big enough), and costs
+//	O(log n) instead of a walk down the list.
+//
+//	Items with the same key come out in the order they were inserted,
+//	as they would from List::SortedRemove.  Every item inserted gets a
+//	handle, that can be used to cancel it while it is on the heap, in
+//	O(log n) too: the handle names a slot that always knows where the
+//	item is in the array.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines a "heap" of items, each with an integer
+// key; the item with the smallest key is at the top.  "Item" must be
+// copyable and have a default constructor.
+//
+// A handle is the slot of the item (low HandleSlotBits bits) and how
+// many times that slot had been used before (the rest), so that a handle
+// of an item that is no longer on the heap is not mistaken for the item
+// now in its slot -- unless the slot was reused 2^16 times since.
+
+const int HandleSlotBits = 16;
+const int MaxHeapSize = 1 << HandleSlotBits;	// items on a heap at once
+
+template <class Item>
+class Heap {
+  public:
+    Heap(int initialSize = 16);	// initialize the heap
+    ~Heap();			// de-allocate the heap
+
+    unsigned Insert(Item item, int key);	// Put item on the heap;
+					// returns a handle for Cancel
+    bool RemoveMin(Item *itemPtr, int *keyPtr);
+					// Take the top item off the heap
+    bool PeekMin(Item *itemPtr, int *keyPtr);
+					// Same, but leave it on the heap
+    bool Cancel(unsigned handle, Item *itemPtr);
+					// Take the item with this handle
+					// off the heap, wherever it is
+
+    void Apply(void (*func)(Item *));	// Apply "func" to all items,
+					// *not* in order
+    void ShiftKeys(int delta);		// Subtract "delta" from every key
+    bool IsEmpty() { return numItems == 0; }
+    int NumItems() { return numItems; }
+
+  private:
+    struct HeapNode {
+	Item item;		// item on the heap
+	int key;		// priority of the item
+	unsigned order;		// insertion order, among the same key
+	int slot;		// entry in "position" for this item
+    };
+
+    HeapNode *nodes;		// the heap: nodes[0] is the top, the
+				// children of nodes[i] are 2i+1 and 2i+2
+    int numItems;		// nodes in use
+    int size;			// nodes allocated, and slots
+    unsigned nextOrder;		// order of the next item inserted
+
+    int *position;		// position[s]: index in "nodes" of the
+				// item in slot s, -1 if the slot is free
+    unsigned *uses;		// uses[s]: times slot s was taken
+    int *freeSlots;		// stack of the free slots
+    int numFree;
+
+    bool Before(HeapNode *a, HeapNode *b)	// does a come out before b?
+	{ return (a->key < b->key) ||
+		 ((a->key == b->key) && ((int) (a->order - b->order) < 0)); }
+				// (orders compared modulo wraparound)
+    void Place(int i, HeapNode *node)	// put "node" at nodes[i]
+	{ nodes[i] = *node; position[node->slot] = i; }
+    void Grow();		// double the room for items
+    void SiftUp(int i);		// restore the heap order around nodes[i]
+    void SiftDown(int i);
+    void Take(int i, Item *itemPtr, int *keyPtr);
+				// remove nodes[i] from the heap
+};
+
+//----------------------------------------------------------------------
+// Heap::Heap
+//	Initialize a heap, empty to start with, with room for
+//	"initialSize" items.  The heap grows as needed.
+//----------------------------------------------------------------------
+
+template <class Item>
+Heap<Item>::Heap(int initialSize)
+{
+    ASSERT((initialSize > 0) && (initialSize <= MaxHeapSize));
+    size = initialSize;
+    nodes = new HeapNode[size];
+    position = new int[size];
+    uses = new unsigned[size];
+    freeSlots = new int[size];
+    for (int s = 0; s < size; s++) {
+	position[s] = -1;
+	uses[s] = 0;
+	freeSlots[s] = size - 1 - s;	// slot 0 on top
+    }
+    numFree = size;
+    numItems = 0;
+    nextOrder = 0;
+}
+
+//----------------------------------------------------------------------
+// Heap::~Heap
+//	De-allocate the heap.  As with List, the items themselves are not
+//	de-allocated, if they are pointers.
+//----------------------------------------------------------------------
+
+template <class Item>
+Heap<Item>::~Heap()
+{
+    delete [] nodes;
+    delete [] position;
+    delete [] uses;
+    delete [] freeSlots;
+}
+
+//----------------------------------------------------------------------
+// Heap::Grow
+//	Double the arrays, when every slot is in use.  The new slots are
+//	all free.
+//----------------------------------------------------------------------
+
+template <class Item>
+void
+Heap<Item>::Grow()
+{
+    int newSize = 2 * size;
+    HeapNode *bigger = new HeapNode[newSize];
+    int *newPosition = new int[newSize];
+    unsigned *newUses = new unsigned[newSize];
+    int *newFree = new int[newSize];
+
+    ASSERT((numFree == 0) && (newSize <= MaxHeapSize));
+    for (int i = 0; i < size; i++) {
+	bigger[i] = nodes[i];
+	newPosition[i] = position[i];
+	newUses[i] = uses[i];
+    }
+    for (int s = size; s < newSize; s++) {
+	newPosition[s] = -1;
+	newUses[s] = 0;
+	newFree[numFree++] = newSize - 1 - (s - size);
+    }
+    delete [] nodes;
+    delete [] position;
+    delete [] uses;
+    delete [] freeSlots;
+    nodes = bigger;
+    position = newPosition;
+    uses = newUses;
+    freeSlots = newFree;
+    size = newSize;
+}
+
+//----------------------------------------------------------------------
+// Heap::Insert
+//      Put "item" on the heap, with priority "key".  The arrays are
+//	doubled when they are full.
+//
+// Returns:
+//	A handle for the item, that Cancel will recognize for as long as
+//	the item is on the heap.
+//----------------------------------------------------------------------
+
+template <class Item>
+unsigned
+Heap<Item>::Insert(Item item, int key)
+{
+    HeapNode node;
+
+    if (numFree == 0)
+	Grow();
+    node.item = item;
+    node.key = key;
+    node.order = nextOrder++;
+    node.slot = freeSlots[--numFree];
+    uses[node.slot]++;
+
+    Place(numItems, &node);
+    numItems++;
+    SiftUp(numItems - 1);
+    return node.slot | (uses[node.slot] << HandleSlotBits);
+}
+
+//----------------------------------------------------------------------
+// Heap::RemoveMin
+//      Remove the item with the smallest key from the heap.  Of the
+//	items with that key, the one inserted first is removed.
+//
+// Returns:
+//	false if the heap is empty; otherwise sets *itemPtr to the item
+//	and, if "keyPtr" is not NULL, *keyPtr to its key.
+//----------------------------------------------------------------------
+
+template <class Item>
+bool
+Heap<Item>::RemoveMin(Item *itemPtr, int *keyPtr)
+{
+    if (IsEmpty())
+	return false;
+    Take(0, itemPtr, keyPtr);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// Heap::PeekMin
+//      Like RemoveMin, but leave the item on the heap.
+//----------------------------------------------------------------------
+
+template <class Item>
+bool
+Heap<Item>::PeekMin(Item *itemPtr, int *keyPtr)
+{
+    if (IsEmpty())
+	return false;
+    if (itemPtr != NULL)
+	*itemPtr = nodes[0].item;
+    if (keyPtr != NULL)
+	*keyPtr = nodes[0].key;
+    return true;
+}
+
+//----------------------------------------------------------------------
+// Heap::Cancel
+//      Remove the item with handle "handle" from the heap.  Its slot
+//	says where it is, so this is O(log n).
+//
+// Returns:
+//	false if no item on the heap has that handle (it was removed
+//	already); otherwise sets *itemPtr to the item, if not NULL.
+//----------------------------------------------------------------------
+
+template <class Item>
+bool
+Heap<Item>::Cancel(unsigned handle, Item *itemPtr)
+{
+    int slot = handle & (MaxHeapSize - 1);
+
+    if ((slot >= size) || (position[slot] < 0)
+	|| ((uses[slot] << HandleSlotBits) != (handle & ~(MaxHeapSize - 1))))
+	return false;
+    Take(position[slot], itemPtr, NULL);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// Heap::Apply
+//      Apply a function to each item on the heap, in array order (which
+//	is not the order they would be removed in).
+//----------------------------------------------------------------------
+
+template <class Item>
+void
+Heap<Item>::Apply(void (*func)(Item *))
+{
+    for (int i = 0; i < numItems; i++)
+	(*func)(&nodes[i].item);
+}
+
+//----------------------------------------------------------------------
+// Heap::ShiftKeys
+//      Subtract "delta" from the key of every item.  The relative order
+//	of the items does not change, so neither do the handles.
+//----------------------------------------------------------------------
+
+template <class Item>
+void
+Heap<Item>::ShiftKeys(int delta)
+{
+    for (int i = 0; i < numItems; i++)
+	nodes[i].key -= delta;
+}
+
+//----------------------------------------------------------------------
+// Heap::Take
+//      Remove nodes[i], putting the last node in its place, and move
+//	that node up or down until the heap is in order again.  The slot
+//	of the removed item is free again.
+//----------------------------------------------------------------------
+
+template <class Item>
+void
+Heap<Item>::Take(int i, Item *itemPtr, int *keyPtr)
+{
+    ASSERT((i >= 0) && (i < numItems));
+    int slot = nodes[i].slot;
+
+    if (itemPtr != NULL)
+	*itemPtr = nodes[i].item;
+    if (keyPtr != NULL)
+	*keyPtr = nodes[i].key;
+    position[slot] = -1;
+    freeSlots[numFree++] = slot;
+    numItems--;
+    if (i < numItems) {
+	Place(i, &nodes[numItems]);
+	if ((i > 0) && Before(&nodes[i], &nodes[(i - 1) / 2]))
+	    SiftUp(i);
+	else
+	    SiftDown(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// Heap::SiftUp
+//      Move nodes[i] up, while it comes out before its parent.
+//----------------------------------------------------------------------
+
+template <class Item>
+void
+Heap<Item>::SiftUp(int i)
+{
+    HeapNode moving = nodes[i];
+
+    while (i > 0) {
+	int parent = (i - 1) / 2;
+
+	if (!Before(&moving, &nodes[parent]))
+	    break;
+	Place(i, &nodes[parent]);
+	i = parent;
+    }
+    Place(i, &moving);
+}
+
+//----------------------------------------------------------------------
+// Heap::SiftDown
+//      Move nodes[i] down, while one of its children comes out before it.
+//----------------------------------------------------------------------
+
+template <class Item>
+void
+Heap<Item>::SiftDown(int i)
+{
+    HeapNode moving = nodes[i];
+
+    for (;;) {
+	int child = 2 * i + 1;
+
+	if (child >= numItems)
+	    break;
+	if ((child + 1 < numItems) && Before(&nodes[child + 1], &nodes[child]))
+	    child++;
+	if (!Before(&nodes[child], &moving))
+	    break;
+	Place(i, &nodes[child]);
+	i = child;
+    }
+    Place(i, &moving);
+}
+
+#endif // HEAP_H
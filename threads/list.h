@@ -57,6 +57,7 @@ class List {
     // Routines to put/get items on/off list in order (sorted by key)
     void SortedInsert(Item item, int sortKey);	// Put item into list
     Item SortedRemove(int *keyPtr); 	  	// Remove first item from list
+    Item SortedPeek(int *keyPtr);		// Same, but leave it on the list
 
   private:
     typedef ListElement<Item> ListNode;
@@ -317,5 +318,25 @@ List<Item>::SortedRemove(int *keyPtr)
     return thing;
 }
 
+//----------------------------------------------------------------------
+// List::SortedPeek
+//      Return the first item on a sorted list, and its priority value
+//	in *keyPtr, without removing it.
+//
+// Returns:
+//	The first item, NULL if nothing on the list.
+//----------------------------------------------------------------------
+
+template <class Item>
+Item
+List<Item>::SortedPeek(int *keyPtr)
+{
+    if (IsEmpty()) 
+	return Item();
+    if (keyPtr != NULL)
+        *keyPtr = first->key;
+    return first->item;
+}
+
 
 #endif // LIST_H
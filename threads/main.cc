@@ -8,20 +8,31 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
+// Usage: nachos -d <debugflags> -rs <random seed #> -p [<time slice>]
+//		-s -b -tlb <organization> -vm <replacement policy>
+//		-x <nachos file> -c <consoleIn> <consoleOut>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
 //              -o <other machine id>
-//              -z
+//              -z -B <benchmark>
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -p preempts kernel threads at the end of a time slice, of the
+//	microseconds of CPU time given (cf. preemptive.cc)
 //    -z prints the copyright message
+//    -B runs one of the benchmarks (cf. threadtest.cc)
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -b runs user programs through the basic-block execution engine
+//    -tlb sets the organization of the TLB: "direct" (mapped), "full"
+//	(associative, the default) or a number of ways per set
+//    -tlbr picks the TLB replacement policy (with a TLB): "fifo", "nru",
+//	"random" or "clock" (the default)
+//    -vm picks the page replacement policy (with VM): "fifo", "clock",
+//	"eclock" (enhanced clock), "wsclock", "aging" or "2q"
 //    -x runs a user program
 //    -c tests the console
 //
@@ -57,6 +68,7 @@
 // External functions used by this file
 
 void ThreadTest();
+void Benchmark(const char *name);
 void Copy(const char *unixFile, const char *nachosFile);
 void Print(const char *file);
 void PerformanceTest(void);
@@ -95,6 +107,11 @@ main(int argc, char **argv)
 	argCount = 1;
         if (!strcmp(*argv, "-z"))               // print copyright
             printf ("%s",copyright);
+        else if (!strcmp(*argv, "-B")) {	// run a benchmark
+	    ASSERT(argc > 1);
+            Benchmark(*(argv + 1));
+            argCount = 2;
+        }
 #ifdef USER_PROGRAM
         if (!strcmp(*argv, "-x")) {        	// run a user program
 	    ASSERT(argc > 1);
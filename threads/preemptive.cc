@@ -1,6 +1,29 @@
 // preemptive.cc 
 //	Extension to make kernel threads be periodically preempted
-//      It only works on Linux x86 environments
+//      It works on any host with POSIX interval timers
+//
+//	A virtual interval timer of the host (it only counts the CPU
+//	time of Nachos itself) sends SIGVTALRM at the end of each time
+//	slice, and the signal handler switches the running thread out,
+//	at whatever point it is.  Between signals it costs nothing.
+//
+//	The host only looks at its CPU time timers on each tick of its
+//	own clock (a jiffy: 4 ms with HZ=250, 1 ms with HZ=1000), so a
+//	time slice shorter than that lasts a whole jiffy.  POSIX timers
+//	on CLOCK_PROCESS_CPUTIME_ID are checked the same way on Linux,
+//	so they would not do better.  CPU time divided by Preemptions()
+//	gives the slice really achieved.
+//
+//	The thread is only switched out right away if that is safe:
+//	Nachos kernel code running with interrupts enabled.  Otherwise:
+//
+//	- with interrupts disabled, or while simulating user code, the
+//	  switch is left for the end of the critical section or the
+//	  clock tick (Interrupt::YieldOnReturn), as the timer device does;
+//
+//	- in the middle of the C library (malloc, printf...) the switch
+//	  is retried shortly after, because the next thread could need
+//	  the locks that the library is holding.
 //
 // Copyright (c) 2007 Universidad de Las Palmas de Gran Canaria
 //
@@ -15,157 +38,126 @@
 #include "system.h"
 
 // UNIX and Linux-specific headers
-#include <unistd.h>
-#include <sys/ptrace.h>
-#include <sys/wait.h>
-#include <sys/user.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+// How long to wait before retrying a switch that was not safe,
+// in microseconds
+#define RETRY_LENGTH 100
 
-static void ContextSwitch ();
-static void MonitorProcess ( int childPid, unsigned long timeSliceLength );
-static void LetMeBeMonitored ();
+static void TimeSliceOver ( int sig, siginfo_t *info, void *context );
+static void StartTimer ( unsigned long length );
+static bool InNachosCode ( void *context );
 
 static bool inContextSwitch = false;
+static unsigned long sliceLength = 0;
+static int preemptions = 0;
+
+// Limits of the code of the Nachos program itself (set by the linker)
+extern char __executable_start, etext;
 
 // Set up the preemptive scheduler
-// The 'timeSliceLength' argument means how many machine instructions
-// will last the time slice for every kernel thread
+// The 'timeSliceLength' argument means how many microseconds
+// of CPU time will last the time slice for every kernel thread
 
 void PreemptiveScheduler::SetUp ( unsigned long timeSliceLength )
 {
-  int  childPid = fork();
-  switch ( childPid ) {
-    case -1:
-      DEBUG ( 'p', "Preemptive scheduler: unable to launch child process\n" );
-      ASSERT (false);
-      break;
-    
-    // child process: original Nachos code
-    case 0:
-      LetMeBeMonitored ();
-      // resumes Nachos execution as a child process
-      return;
-    
-    // parent process: monitor code
-    default:
-      MonitorProcess ( childPid, timeSliceLength );
-    } // end of switch
+  struct sigaction action;
+
+  ASSERT ( timeSliceLength > 0 && sliceLength == 0 );
+  sliceLength = timeSliceLength;
+  preemptions = 0;
+
+  // the handler may switch to another thread, which must be
+  // preempted in turn: so the signal is not blocked while it runs
+  action.sa_sigaction = TimeSliceOver;
+  sigemptyset ( &action.sa_mask );
+  action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_RESTART;
+  sigaction ( SIGVTALRM, &action, NULL );
+
+  StartTimer ( sliceLength );
+  DEBUG ( 'p', "Preemptive scheduler: time slice of %lu us\n",
+          sliceLength );
 }
 
 
-void LetMeBeMonitored ()
+// Stop the time slicing
+
+PreemptiveScheduler::~PreemptiveScheduler ()
 {
-  // allow the parent process to ptrace me
-  ptrace ( PTRACE_TRACEME, 0, NULL, NULL );
-  
-  DEBUG ( 'p', "Preemptive scheduler: child process will be ptraced\n" );
-  
-  // Raise a signal to bring back control to the parent
-  raise(SIGUSR1);
+  StartTimer ( 0 );
+  signal ( SIGVTALRM, SIG_DFL );
+  sliceLength = 0;
+  DEBUG ( 'p', "Preemptive scheduler: finished, %d preemptions\n",
+          preemptions );
 }
 
 
-void MonitorProcess ( int childPid, unsigned long timeSliceLength )
+int PreemptiveScheduler::Preemptions ()
 {
-  // machine instruction counter
-  long long instructionCounter = 1;
-  
-  while (true) {
-    
-    // Wait for child process
-    int wait_val;
-    wait (&wait_val);
-    if ( WIFEXITED(wait_val) ) {
-      DEBUG ( 'p', "Preemptive scheduler: child process terminated\n" );
-      break;
-    }
-
-    // Increment instruction counter
-    instructionCounter++;
-    
-    // From time to time, insert machine code to force a context switch
-    if ( instructionCounter % timeSliceLength == 0 )
-    {
-      // Get child value of 'inContextSwitch'
-      long incs = ptrace ( PTRACE_PEEKDATA, childPid, (long)&inContextSwitch, NULL );
-      
-      if ( incs == 0 ) { 
-        DEBUG ( 'p', "Preemptive scheduler: "
-                     "forcing a context switch at instruction %lld\n",
-                     instructionCounter );
-                     
-        struct user_regs_struct regs;
-        
-        // Get child process registers
-        ptrace ( PTRACE_GETREGS,  childPid, NULL, &regs );
-
-	// build a call stack frame by inserting EIP/RIP on top of the stack
-#ifdef HOST_i386        
-        regs.esp = regs.esp - 4;
-        ptrace ( PTRACE_POKEDATA, childPid, regs.esp, regs.eip );
-        // force a jump to ContextSwitch()
-        regs.eip = (long) ContextSwitch;
-#elif defined(HOST_x86_64)
-        regs.rsp = regs.rsp - 8;
-        ptrace ( PTRACE_POKEDATA, childPid, regs.rsp, regs.rip );
-        // force a jump to ContextSwitch()
-        regs.rip = (long long) ContextSwitch;
-#endif
+  return preemptions;
+}
 
-        // Store new register values in the child process
-        // The child will now make a call to ContextSwitch()
-        ptrace ( PTRACE_SETREGS, childPid, NULL, &regs );
-      }
-    }
-    
-    // Resume child execution
-    ptrace( PTRACE_SINGLESTEP, childPid, NULL, NULL );
-  }
 
-  DEBUG ( 'p', "Preemptive scheduler: Finished\n" );
-  exit(0);
+// Program the host timer to go off every 'length' microseconds
+// of CPU time (0 stops it)
+
+static void StartTimer ( unsigned long length )
+{
+  struct itimerval value;
+
+  value.it_value.tv_sec = length / 1000000;
+  value.it_value.tv_usec = length % 1000000;
+  value.it_interval = value.it_value;
+  setitimer ( ITIMER_VIRTUAL, &value, NULL );
 }
 
 
-// Force a context switch
-// This call is made asynchronously from the
-// parent process, using ptrace() features
+// Was the program running its own code when the signal came,
+// and not the C library's?
 
-static void ContextSwitch (void)
+static bool InNachosCode ( void *context )
 {
-  // prevent register loss: save all registers
-#ifdef HOST_i386        
-  __asm__ ("pushal");
-  __asm__ ("subl $8, %esp");
-#elif defined(HOST_x86_64)
-  // push all registers
-  __asm__ ("push %rax; push %rbx; push %rcx; push %rdx");
-  __asm__ ("push %rsi; push %rdi; push %rsp; push %rbp");
-  __asm__ ("push %r8; push %r9; push %r10; push %r11; push %r12; push %r13; push %r14; push %r15");
-  __asm__ ("sub $16, %rsp");
+  char *pc;
+
+#if defined(HOST_x86_64)
+  pc = (char *) ((ucontext_t *) context)->uc_mcontext.gregs[REG_RIP];
+#elif defined(HOST_i386)
+  pc = (char *) ((ucontext_t *) context)->uc_mcontext.gregs[REG_EIP];
+#else
+  return true;		// no way to tell
 #endif
-  
+  return pc >= &__executable_start && pc < &etext;
+}
+
+
+// Force a context switch
+// This call is made asynchronously by the host,
+// when the time slice is over
+
+static void TimeSliceOver ( int sig, siginfo_t *info, void *context )
+{
+  // the running thread is already being switched out
+  if ( inContextSwitch )
+    return;
+
   inContextSwitch = true;
-  
-  // make a context switch if interrupts are enabled
-  if ( interrupt->getLevel() == IntOn ) {
+
+  if ( interrupt->getLevel() == IntOff
+       || interrupt->getStatus() != SystemMode ) {
+    // make the context switch when it is safe
+    interrupt->YieldOnReturn();
+    StartTimer ( sliceLength );
+    inContextSwitch = false;
+  } else if ( !InNachosCode ( context ) ) {
+    StartTimer ( RETRY_LENGTH );
     inContextSwitch = false;
-    currentThread->Yield();
   } else {
-    interrupt->YieldOnReturn();
+    // the next thread gets a whole time slice
+    StartTimer ( sliceLength );
+    preemptions++;
     inContextSwitch = false;
+    currentThread->Yield();
   }
-  
-  // restore old register values
-#ifdef HOST_i386        
-  __asm__ ("addl $8, %esp");
-  __asm__ ("popal");
-#elif defined(HOST_x86_64)
-  __asm__ ("add $16, %rsp");
-  // pop all registers
-  __asm__ ("pop %r15; pop %r14; pop %r13; pop %r12; pop %r11; pop %r10; pop %r9; pop %r8");
-  __asm__ ("pop %rbp; pop %rsp; pop %rdi; pop %rsi");
-  __asm__ ( "pop %rdx; pop %rcx; pop %rbx; pop %rax" );
-#endif
-
 }
-
@@ -1,6 +1,6 @@
 // preemptive.cc 
 //	Extension to make kernel threads be periodically preempted
-//      It only works on Linux x86 environments
+//      It works on any host with POSIX interval timers
 //
 // Copyright (c) 2007 Universidad de Las Palmas de Gran Canaria
 //
@@ -16,13 +16,21 @@ class PreemptiveScheduler
 {
   public:
     PreemptiveScheduler() {}
-    ~PreemptiveScheduler() {}
+    ~PreemptiveScheduler();	// stop the time slicing
     
     // Set up time slicing between kernel threads.
     //   'timeSliceLength' is the time slice duration,
-    //   measured in native x86 machine instructions
-    
+    //   measured in microseconds of host CPU time
+    //   (there can be only one time slicing at a time)
+    //   The host rounds it up to its own clock tick
+    //   (see preemptive.cc)
+
     void SetUp ( unsigned long timeSliceLength );
+
+    // Number of times a thread was switched out
+    // at the end of its time slice, so far
+
+    int Preemptions ();
 };
 
 #endif
@@ -11,8 +11,11 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+//	One FIFO queue per priority level, and a bitmap of the levels
+//	that have ready threads, so that both putting a thread on the
+//	ready list and finding the next one to run take constant time.
+//	The level of a thread starts at its priority, and moves with
+//	the multilevel feedback policy (see MLFQ_DEPTH).
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -23,6 +26,26 @@
 #include "system.h"
 #include "utility.h"
 
+//----------------------------------------------------------------------
+// HighestBit
+// 	Index of the most significant bit set in "mask", which is not 0.
+//	With gcc it is a single find-first-set (bsr) instruction.
+//----------------------------------------------------------------------
+
+static inline int
+HighestBit(unsigned mask)
+{
+#ifdef __GNUC__
+    return 31 - __builtin_clz(mask);
+#else
+    int bit = 0;
+
+    while (mask >>= 1)
+	bit++;
+    return bit;
+#endif
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads to empty.
@@ -30,8 +53,9 @@
 
 Scheduler::Scheduler()
 { 
-    for (int i=0; i<MAX_PRIORITY; i++)
-        pqueue[i] = new List<Thread*>;
+    ASSERT(MAX_PRIORITY <= 32);		// one bit per level in readyMask
+    readyMask = 0;
+    expired = false;
 } 
 
 //----------------------------------------------------------------------
@@ -41,8 +65,6 @@ Scheduler::Scheduler()
 
 Scheduler::~Scheduler()
 { 
-    for (int i=0; i<MAX_PRIORITY; i++)
-        delete pqueue[i];
 } 
 
 //----------------------------------------------------------------------
@@ -50,6 +72,9 @@ Scheduler::~Scheduler()
 // 	Mark a thread as ready, but not running.
 //	Put it on the ready list, for later scheduling onto the CPU.
 //
+//	If it is at a higher level than the running thread, it takes
+//	the CPU as soon as it is safe, like after a time slice.
+//
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
 
@@ -60,12 +85,15 @@ Scheduler::ReadyToRun (Thread *thread)
 
     thread->setStatus(READY);
 
-    // Get the thread priority and append to the corresponding queue
-    int p = thread->getPriority();
+    // Append the thread at the end of the queue of its level
+    int p = thread->getLevel();
 
-    // Append the thread at the end of the corresponding priority queue
-    // saturating value if bigger than MAX_PRIORITY
-    pqueue[p < MAX_PRIORITY ? p : MAX_PRIORITY]->Append(thread);
+    pqueue[p].Append(thread);
+    readyMask |= 1u << p;
+
+    if ((thread != currentThread) && (p > currentThread->getLevel())
+	&& (interrupt->getStatus() != IdleMode))
+	interrupt->YieldOnReturn();
 }
 
 //----------------------------------------------------------------------
@@ -79,14 +107,15 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    int p = MAX_PRIORITY - 1;
-    for( ; p>=0 ; p--)
-        if(!pqueue[p]->IsEmpty())
-            break;
-    
-    if(p == -1) return NULL;
+    if (readyMask == 0)
+	return NULL;
+
+    int p = HighestBit(readyMask);
+    Thread *thread = pqueue[p].Remove();
 
-    return pqueue[p]->Remove();
+    if (pqueue[p].IsEmpty())
+	readyMask &= ~(1u << p);
+    return thread;
 }
 
 //----------------------------------------------------------------------
@@ -120,6 +149,7 @@ Scheduler::Run (Thread *nextThread)
 
     currentThread = nextThread;		    // switch to the next thread
     currentThread->setStatus(RUNNING);      // nextThread is now running
+    expired = false;			    // with a whole quantum
     
     DEBUG('t', "Switching from thread \"%s\" to thread \"%s\"\n",
 	  oldThread->getName(), nextThread->getName());
@@ -138,7 +168,10 @@ Scheduler::Run (Thread *nextThread)
     // before now (for example, in Thread::Finish()), because up to this
     // point, we were still running on the old thread's stack!
     if (threadToBeDestroyed != NULL) {
-        delete threadToBeDestroyed;
+	if (threadToBeDestroyed->isJoinable())
+	    threadToBeDestroyed->Reclaim();	// Join deletes the rest
+	else
+	    delete threadToBeDestroyed;
 	threadToBeDestroyed = NULL;
     }
     
@@ -150,6 +183,74 @@ Scheduler::Run (Thread *nextThread)
 #endif
 }
 
+//----------------------------------------------------------------------
+// Scheduler::QuantumExpired
+// 	The timer went off while the current thread was running: it is
+//	CPU bound, so it goes down one level (it is put on the ready
+//	list in the new one when it yields).
+//
+//	Returns whether it should give up the CPU: only to a thread at
+//	its level or above, so a thread running with a level lent by a
+//	lock (see Lock::Acquire) is not held back by lower ones.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::QuantumExpired ()
+{
+    int level = currentThread->getOwnLevel();
+
+    expired = true;
+    if ((level > currentThread->getPriority() - MLFQ_DEPTH) && (level > 0))
+	currentThread->setLevel(level - 1);
+    return (readyMask != 0)
+	&& (HighestBit(readyMask) >= currentThread->getLevel());
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Blocking
+// 	"thread", the current thread, is going to sleep.  If it did
+//	before using up its quantum, it is waiting for I/O most of the
+//	time, so it goes up one level.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Blocking (Thread *thread)
+{
+    int level = thread->getOwnLevel();
+
+    if (!expired && (level < thread->getPriority() + MLFQ_BOOST)
+	&& (level < MAX_PRIORITY - 1))
+	thread->setLevel(level + 1);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Donate
+// 	Set the level lent to "thread" by the threads waiting for the
+//	locks it holds ("level", -1 for none).  If "thread" is on the
+//	ready list, it moves to the queue of its new level; if it is
+//	the running thread and it goes below a ready one, it gives up
+//	the CPU as soon as it is safe.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Donate (Thread *thread, int level)
+{
+    int old = thread->getLevel();
+    int p;
+
+    thread->setDonated(level);
+    p = thread->getLevel();
+    if ((thread->getStatus() == READY) && (p != old)) {
+	pqueue[old].RemoveThread(thread);
+	if (pqueue[old].IsEmpty())
+	    readyMask &= ~(1u << old);
+	pqueue[p].Append(thread);
+	readyMask |= 1u << p;
+    } else if ((thread == currentThread) && (readyMask != 0)
+	       && (HighestBit(readyMask) > p))
+	interrupt->YieldOnReturn();
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Print
 // 	Print the scheduler state -- in other words, the contents of
@@ -168,7 +269,7 @@ Scheduler::Print()
     
     for(int i=MAX_PRIORITY-1; i>=0; i--){
         printf("Priority %d: ", i);
-        pqueue[i]->Apply(ThreadPrint);
+        pqueue[i].Apply(ThreadPrint);
         printf("\n");
     } 
 
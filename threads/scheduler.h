@@ -15,6 +15,14 @@
 
 #define MAX_PRIORITY 10
 
+// Multilevel feedback: a thread that uses up its quantum (the timer
+// interrupts it while it runs) goes down one level, at most MLFQ_DEPTH
+// levels below its priority; one that blocks before that goes up one
+// level, at most MLFQ_BOOST above its priority.  So CPU bound threads
+// give way to the ones that mostly wait for I/O, like a shell.
+#define MLFQ_DEPTH 3
+#define MLFQ_BOOST 1
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
@@ -29,9 +37,20 @@ class Scheduler {
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
+
+    bool QuantumExpired();		// The timer interrupted the running
+					// thread
+    void Blocking(Thread* thread);	// The running thread is going to
+					// sleep
+    void Donate(Thread* thread, int level);	// Change the level lent
+					// to "thread" through its locks
     
   private:
-    List<Thread*> *pqueue[MAX_PRIORITY];     // prority multiqueue
+    ThreadQueue pqueue[MAX_PRIORITY];	// prority multiqueue
+    unsigned readyMask;			// bit p is set if pqueue[p] is not
+					// empty
+    bool expired;			// has the running thread used up its
+					// quantum?
 };
 
 #endif // SCHEDULER_H
@@ -37,7 +37,6 @@ Semaphore::Semaphore(const char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List<Thread*>;
 }
 
 //----------------------------------------------------------------------
@@ -48,7 +47,6 @@ Semaphore::Semaphore(const char* debugName, int initialValue)
 
 Semaphore::~Semaphore()
 {
-    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -67,7 +65,7 @@ Semaphore::P()
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
     
     while (value == 0) { 			// semaphore not available
-	queue->Append(currentThread);		// so go to sleep
+	queue.Append(currentThread);		// so go to sleep
 	currentThread->Sleep();
     } 
     value--; 					// semaphore available, 
@@ -90,7 +88,7 @@ Semaphore::V()
     Thread *thread;
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
-    thread = queue->Remove();
+    thread = queue.Remove();
     if (thread != NULL)	   // make thread ready, consuming the V immediately
 	scheduler->ReadyToRun(thread);
     value++;
@@ -102,34 +100,117 @@ Semaphore::V()
 // Lock::Lock 
 //----------------------------------------------------------------------
 Lock::Lock(const char* debugName) {
-    sem = new Semaphore(debugName, 1);
     name = debugName;
     acquiredBy = NULL;
+    nextHeld = NULL;
 }
 
 //----------------------------------------------------------------------
 // Lock::~Lock 
 //----------------------------------------------------------------------
 Lock::~Lock() {
-    delete sem;
 }
 
 //----------------------------------------------------------------------
 // Lock::Acquire
+// 	If the lock is busy, wait for the holder to hand it over, lending
+//	it our level meanwhile.  The waiters are kept sorted by level
+//	(FIFO among the same level), so the most urgent one gets it first.
 //----------------------------------------------------------------------
 void Lock::Acquire() {
     ASSERT(!isHeldByCurrentThread());
-    sem->P();
-    acquiredBy = currentThread;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    if (acquiredBy == NULL)
+        Take(currentThread);
+    else {
+        int level = currentThread->getLevel();
+
+        currentThread->waitingFor = this;
+        waiters.InsertByLevel(currentThread);
+        Donate(level);
+        currentThread->Sleep();
+        ASSERT(acquiredBy == currentThread);	// handed over by Release
+    }
+    interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
 // Lock::Release
+// 	Hand the lock over to the first waiter, if any.  Both threads
+//	are left with the level lent by the locks they hold after it.
 //----------------------------------------------------------------------
 void Lock::Release() {
     ASSERT(isHeldByCurrentThread());
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Lock **link = &currentThread->locksHeld;
+    Thread *next;
+
+    while (*link != this)
+        link = &(*link)->nextHeld;
+    *link = nextHeld;
     acquiredBy = NULL;
-    sem->V();
+
+    next = waiters.Remove();
+    if (next != NULL)
+        Take(next);
+    scheduler->Donate(currentThread, Lent(currentThread));
+    if (next != NULL) {
+        scheduler->Donate(next, Lent(next));
+        scheduler->ReadyToRun(next);
+    }
+    interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::Take
+// 	Make "thread" the holder of the lock.
+//----------------------------------------------------------------------
+void Lock::Take(Thread *thread) {
+    acquiredBy = thread;
+    nextHeld = thread->locksHeld;
+    thread->locksHeld = this;
+    thread->waitingFor = NULL;
+}
+
+//----------------------------------------------------------------------
+// Lock::Donate
+// 	Lend "level" to the holder of the lock, and along the chain of
+//	locks it is waiting for, until a holder that already runs at
+//	that level.  A holder that is waiting moves up in the queue of
+//	the lock it waits for.  The chain ends, since a thread waits
+//	for only one lock (a deadlock cycle stops after one turn).
+//----------------------------------------------------------------------
+void Lock::Donate(int level) {
+    Lock *lock = this;
+
+    while ((lock != NULL) && (lock->acquiredBy->getLevel() < level)) {
+        Thread *holder = lock->acquiredBy;
+
+        scheduler->Donate(holder, level);
+        lock = holder->waitingFor;
+        if (lock != NULL) {
+            lock->waiters.RemoveThread(holder);
+            lock->waiters.InsertByLevel(holder);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// Lock::Lent
+// 	Highest level among the threads waiting for the locks "thread"
+//	holds, or -1 if none.
+//----------------------------------------------------------------------
+int Lock::Lent(Thread *thread) {
+    int level = -1;
+
+    for (Lock *lock = thread->locksHeld; lock != NULL; lock = lock->nextHeld) {
+        Thread *first = lock->waiters.Peek();
+
+        if ((first != NULL) && (first->getLevel() > level))
+            level = first->getLevel();
+    }
+    return level;
 }
 
 //----------------------------------------------------------------------
@@ -146,48 +227,51 @@ bool Lock::isHeldByCurrentThread(){
 Condition::Condition(const char* debugName, Lock* conditionLock){
     name = debugName;
     myLock = conditionLock;
-    sem_queue = new List <Semaphore *> ();
 }
 
 //----------------------------------------------------------------------
 // Condition::~Condition
 //----------------------------------------------------------------------
 Condition::~Condition(){
-    delete myLock;
-    delete sem_queue;
 }
 
 //----------------------------------------------------------------------
 // Condition::Wait
+// 	Release the lock and go to sleep atomically, since interrupts
+//	stay disabled until another thread runs.
 //----------------------------------------------------------------------
 void Condition::Wait(){
-    Semaphore *s = new Semaphore(name, 0);
-    sem_queue -> Append(s);
-    
-    myLock -> Release();
-    s -> P();
-    myLock -> Acquire();
-    delete s;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    waiters.Append(currentThread);
+    myLock->Release();
+    currentThread->Sleep();
+    interrupt->SetLevel(oldLevel);
+    myLock->Acquire();
 }
 
 //----------------------------------------------------------------------
 // Condition::Signal
 //----------------------------------------------------------------------
 void Condition::Signal(){
-    if(!sem_queue->IsEmpty()){
-        Semaphore *s = sem_queue -> Remove();
-        s->V();
-   }
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Thread *thread = waiters.Remove();
+
+    if (thread != NULL)
+        scheduler->ReadyToRun(thread);
+    interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
 // Condition::Broadcast
 //----------------------------------------------------------------------
 void Condition::Broadcast(){
-    while(!sem_queue->IsEmpty()){
-        Semaphore *s = sem_queue -> Remove();
-        s->V();
-    }
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Thread *thread;
+
+    while ((thread = waiters.Remove()) != NULL)
+        scheduler->ReadyToRun(thread);
+    interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -52,7 +52,7 @@ class Semaphore {
   private:
     const char* name;        		// para depuraci�n
     int value;         		// valor del sem�foro, siempre es >= 0
-    List<Thread*> *queue;       // Cola con los hilos que esperan en P() porque el
+    ThreadQueue queue;          // Cola con los hilos que esperan en P() porque el
                        		// valor es cero
 };
 
@@ -67,6 +67,13 @@ class Semaphore {
 //
 // Por conveniencia, nadie excepto el hilo que tiene adquirido el cerrojo
 // puede liberarlo. No hay ninguna operaci�n para leer el estado del cerrojo.
+//
+// Herencia de prioridad: el hilo que espera en un Acquire le presta su
+// nivel al que tiene el cerrojo (y si este a su vez espera otro cerrojo,
+// al que tiene ese, y asi siguiendo), para que los hilos de nivel
+// intermedio no lo dejen sin CPU. El Release le pasa el cerrojo al hilo
+// de mayor nivel que lo espera, y el que lo libera vuelve al nivel que
+// le prestan los cerrojos que todavia tiene.
 
 
 class Lock {
@@ -87,8 +94,13 @@ class Lock {
 
   private:         
     const char* name;				// para depuraci�n
-    Semaphore *sem;                 
+    ThreadQueue waiters;             // hilos esperando, por nivel
     Thread *acquiredBy;              // Thread que actualmente posee el lock
+    Lock *nextHeld;                  // siguiente cerrojo de acquiredBy
+
+    void Take(Thread *thread);       // darle el cerrojo a thread
+    void Donate(int level);          // prestar level a quien lo tiene
+    static int Lent(Thread *thread); // nivel prestado a thread
 };
 
 //  La siguiente clase define una "variable condici�n". Una variable condici�n
@@ -145,7 +157,7 @@ class Condition {
   private:
     const char* name;
     Lock* myLock;
-    List <Semaphore *> *sem_queue;
+    ThreadQueue waiters;        // hilos esperando un Signal()
 };
 
 
@@ -24,7 +24,7 @@ Thread *threads[MAX_THREADS];
 
 // 2007, Jose Miguel Santos Espino
 PreemptiveScheduler* preemptiveScheduler = NULL;
-const long long DEFAULT_TIME_SLICE = 50000;
+const long long DEFAULT_TIME_SLICE = 10000;	// microseconds of CPU time
 
 #ifdef FILESYS_NEEDED
 FileSystem  *fileSystem;
@@ -36,11 +36,16 @@ SynchDisk   *synchDisk;
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
 Machine *machine;	// user program memory and registers
+#ifdef USE_TLB
+TLBReplacement tlbReplacement;
+#endif
 
 #ifndef VM
 BitMap *memPages;   // Used to track ram used pages
 #else
 CoreMap *coremap;
+OpenFile *swapFile;
+BitMap *swapSlots;
 #endif
 
 SynchConsole *synchedConsole; // Synchronized console
@@ -85,6 +90,18 @@ bool removeThread(int pid){
     return true;
 }
 
+// Los hijos de parent que nadie esperó ya no se pueden esperar: salen
+// del arreglo, y se borran al terminar (o ya, si terminaron)
+void detachChildren(Thread *parent){
+    for (int i=2; i<MAX_THREADS; i++){
+        if (threads[i] && threads[i]->getParent() == parent) {
+            Thread *child = threads[i];
+            threads[i] = NULL;
+            child->Detach();
+        }
+    }
+}
+
 //----------------------------------------------------------------------
 // TimerInterruptHandler
 // 	Interrupt handler for the timer deviSIGTRAP example -perlce.  The timer device is
@@ -105,7 +122,13 @@ bool removeThread(int pid){
 static void
 TimerInterruptHandler(void* dummy)
 {
-    if (interrupt->getStatus() != IdleMode)
+#if defined(USER_PROGRAM) && defined(VM)
+    if (coremap != NULL)
+	coremap->Sample();		// age the frames, for Aging, and
+					// resume suspended processes
+#endif
+    if ((interrupt->getStatus() != IdleMode)
+	&& scheduler->QuantumExpired())	// charge the running thread
 	interrupt->YieldOnReturn();
 }
 
@@ -133,6 +156,20 @@ Initialize(int argc, char **argv)
     
 #ifdef USER_PROGRAM
     bool debugUserProg = false;	// single step user program
+    bool runBlocks = false;	// run user code a basic block at a time
+    int tlbWays = TLBSize;	// associativity of the TLB
+#endif
+#ifdef USE_TLB
+    TLBReplacement tlbPolicy = ClockTLBReplacement;
+#endif
+#if defined(USER_PROGRAM) && defined(VM)
+#if defined(WSCLOCK)
+    ReplacementPolicy replacement = WSClockReplacement;
+#elif defined(CLOCK)
+    ReplacementPolicy replacement = EnhancedClockReplacement;
+#else
+    ReplacementPolicy replacement = FifoReplacement;
+#endif
 #endif
 #ifdef FILESYS_NEEDED
     bool format = false;	// format disk
@@ -171,6 +208,33 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
 	    debugUserProg = true;
+	else if (!strcmp(*argv, "-b"))
+	    runBlocks = true;
+	else if (!strcmp(*argv, "-tlb")) {
+	    ASSERT(argc > 1);
+	    if (!strcmp(*(argv + 1), "direct"))
+		tlbWays = 1;
+	    else if (!strcmp(*(argv + 1), "full"))
+		tlbWays = TLBSize;
+	    else
+		tlbWays = atoi(*(argv + 1));	// N-way set associative
+	    ASSERT((tlbWays > 0) && (TLBSize % tlbWays == 0));
+	    argCount = 2;
+	}
+#ifdef USE_TLB
+	else if (!strcmp(*argv, "-tlbr")) {
+	    ASSERT(argc > 1);
+	    tlbPolicy = TLBReplacementNamed(*(argv + 1));
+	    argCount = 2;
+	}
+#endif
+#ifdef VM
+	else if (!strcmp(*argv, "-vm")) {
+	    ASSERT(argc > 1);
+	    replacement = ReplacementNamed(*(argv + 1));
+	    argCount = 2;
+	}
+#endif
 #endif
 #ifdef FILESYS_NEEDED
 	if (!strcmp(*argv, "-f"))
@@ -215,12 +279,18 @@ Initialize(int argc, char **argv)
 
     
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg);	// this must come first
+    machine = new Machine(debugUserProg, runBlocks, tlbWays);	// this must come first
+#ifdef USE_TLB
+    tlbReplacement = tlbPolicy;
+    stats->tlbReplacement = TLBReplacementName(tlbPolicy);
+#endif
 
 #ifndef VM
     memPages = new BitMap(NumPhysPages); 
 #else
-    coremap = new CoreMap();
+    coremap = new CoreMap(replacement);
+    swapFile = NULL;
+    swapSlots = new BitMap(SWAP_PAGES);
 #endif
 
     synchedConsole = new SynchConsole(NULL, NULL);
@@ -264,6 +334,11 @@ Cleanup()
     delete memPages;
 #else 
     delete coremap;
+    delete swapSlots;
+    if (swapFile != NULL) {
+	delete swapFile;
+	fileSystem->Remove(SWAP_FILE);
+    }
 #endif
 
 #endif
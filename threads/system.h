@@ -15,6 +15,7 @@
 #include "interrupt.h"
 #include "stats.h"
 #include "timer.h"
+#include "preemptive.h"
 
 // Initialization and cleanup routines
 extern void Initialize(int argc, char **argv); 	// Initialization,
@@ -28,18 +29,27 @@ extern Scheduler *scheduler;			// the ready list
 extern Interrupt *interrupt;			// interrupt status
 extern Statistics *stats;			// performance metrics
 extern Timer *timer;				// the hardware alarm clock
+extern PreemptiveScheduler *preemptiveScheduler; // time slicing of kernel
+						// threads (-p), or NULL
 
 #define MAX_THREADS 256
 extern Thread *threads[MAX_THREADS];
 extern Thread *getThread(int pid);
 extern int newThread(Thread *t);
 extern bool removeThread(int pid);
+extern void detachChildren(Thread *parent);
 
 #ifdef USER_PROGRAM
 
 #include "machine.h"
 extern Machine* machine;	    // user program memory and registers
 
+#ifdef USE_TLB
+#include "addrspace.h"
+extern TLBReplacement tlbReplacement;	// how TLB misses pick the entry
+					// to replace
+#endif
+
 #include "synchconsole.h"      
 extern SynchConsole *synchedConsole;	 // synchronized console
 
@@ -49,6 +59,11 @@ extern BitMap* memPages;        // bitmap of used physical frames
 #else
 #include "coremap.h"
 extern CoreMap *coremap;        // bitmap of used physical frames
+
+#define SWAP_FILE "SWAP"        // el área de swap, de todos los procesos
+#define SWAP_PAGES 1024         // páginas que entran en el swap
+extern OpenFile *swapFile;      // NULL hasta que se desaloje una página
+extern BitMap *swapSlots;       // lugares usados del swap
 #endif
 
 #endif 
@@ -17,7 +17,6 @@
 #include "copyright.h"
 #include "thread.h"
 #include "switch.h"
-#include "synch.h"
 #include "system.h"
 
 // this is put at the top of the execution stack,
@@ -30,16 +29,28 @@ const unsigned STACK_FENCEPOST = 0xdeadbeef;
 //	Thread::Fork.
 //
 //	"threadName" is an arbitrary string, useful for debugging.
+//	"isJoinable" is whether some thread will call Join on it; if
+//	not, it is deleted as soon as it finishes.
 //----------------------------------------------------------------------
 
-Thread::Thread(const char* threadName, int threadPriority)
+Thread::Thread(const char* threadName, int threadPriority, bool isJoinable)
 {
     name =strdup(threadName);
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;
-    port = new Puerto(threadName);
+    joinable = isJoinable;
+    finished = false;
+    joiner = NULL;
+    parent = NULL;
     priority = threadPriority < 0 ? 0 : threadPriority;
+    if (priority >= MAX_PRIORITY)
+        priority = MAX_PRIORITY - 1;
+    level = priority;
+    donated = -1;
+    waitingFor = NULL;
+    locksHeld = NULL;
+    nextInQueue = NULL;
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -62,8 +73,28 @@ Thread::~Thread()
     DEBUG('t', "Deleting thread \"%s\"\n", name);
 
     ASSERT(this != currentThread);
+    if (threadToBeDestroyed == this)	// finished, but nobody switched
+	threadToBeDestroyed = NULL;	// in through Scheduler::Run yet
+    Reclaim();
+    free((char *) name);
+}
+
+//----------------------------------------------------------------------
+// Thread::Reclaim
+// 	Free the stack and the address space of a finished thread.  A
+//	joinable one keeps the rest (its exit code) until it is joined.
+//----------------------------------------------------------------------
+
+void
+Thread::Reclaim()
+{
     if (stack != NULL)
 	DeallocBoundedArray((char *) stack, StackSize * sizeof(HostMemoryAddress));
+    stack = NULL;
+#ifdef USER_PROGRAM
+    delete space;		// frees its frames and swap slots
+    space = NULL;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -138,7 +169,10 @@ Thread::CheckOverflow()
 //	or the execution stack, because we're still running in the thread 
 //	and we're still on the stack!  Instead, we set "threadToBeDestroyed", 
 //	so that Scheduler::Run() will call the destructor, once we're
-//	running in the context of a different thread.
+//	running in the context of a different thread.  A joinable thread
+//	only loses its stack and address space there, and it is deleted
+//	by Join.  The children it did not join are detached, so they do
+//	not wait forever for a Join.
 //
 // 	NOTE: we disable interrupts, so that we don't get a time slice 
 //	between setting threadToBeDestroyed, and going to sleep.
@@ -153,7 +187,11 @@ Thread::Finish (int eCode)
     
     DEBUG('t', "Finishing thread \"%s\"\n", getName());
     
-    port->Send(eCode);
+    exitCode = eCode;
+    finished = true;
+    detachChildren(this);			// nobody will join them now
+    if (joiner != NULL)				// it runs after we switch out
+	scheduler->ReadyToRun(joiner);
     threadToBeDestroyed = currentThread;
     Sleep();					// invokes SWITCH
     // not reached
@@ -161,13 +199,43 @@ Thread::Finish (int eCode)
 
 //----------------------------------------------------------------------
 // Thread::Join
-//	Locks the caller thread until this thread ends
+//	Locks the caller thread until this thread ends, then deletes
+//	it.  Returns its exit code.  Only one thread can join it.
 //----------------------------------------------------------------------
 
 int Thread::Join(){
-    int msg;
-    port->Recv(&msg);
-    return msg;
+    int eCode;
+
+    ASSERT(joinable && (joiner == NULL) && (this != currentThread));
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    if (!finished) {
+	joiner = currentThread;
+	currentThread->Sleep();
+    }
+    interrupt->SetLevel(oldLevel);
+
+    eCode = exitCode;
+    delete this;
+    return eCode;
+}
+
+//----------------------------------------------------------------------
+// Thread::Detach
+//	Nobody is going to join this thread (for instance, its parent
+//	finished first): if it has already finished, delete it now,
+//	and if not, as soon as it finishes.
+//----------------------------------------------------------------------
+
+void
+Thread::Detach()
+{
+    ASSERT(joinable && (joiner == NULL) && (this != currentThread));
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    joinable = false;
+    parent = NULL;
+    if (finished)
+	delete this;
+    interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -235,6 +303,7 @@ Thread::Sleep ()
     
     DEBUG('t', "Sleeping thread \"%s\"\n", getName());
 
+    scheduler->Blocking(this);
     status = BLOCKED;
     while ((nextThread = scheduler->FindNextToRun()) == NULL) {
 	interrupt->Idle();	// no one to run, wait for an interrupt
@@ -374,3 +443,94 @@ Thread::RestoreUserState()
 	machine->WriteRegister(i, userRegisters[i]);
 }
 #endif
+
+//----------------------------------------------------------------------
+// ThreadQueue::Append
+// 	Put "thread" at the end of the queue.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::Append(Thread *thread)
+{
+    thread->nextInQueue = NULL;
+    if (first == NULL)
+	first = thread;
+    else
+	last->nextInQueue = thread;
+    last = thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Remove
+// 	Take the first thread off the queue, NULL if it is empty.
+//----------------------------------------------------------------------
+
+Thread *
+ThreadQueue::Remove()
+{
+    Thread *thread = first;
+
+    if (thread != NULL) {
+	first = thread->nextInQueue;
+	if (first == NULL)
+	    last = NULL;
+	thread->nextInQueue = NULL;
+    }
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::InsertByLevel
+// 	Put "thread" before the first one at a lower level, so that a
+//	queue where every thread went this way stays sorted by level,
+//	FIFO among the same level.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::InsertByLevel(Thread *thread)
+{
+    Thread **link = &first;
+
+    while ((*link != NULL) && ((*link)->getLevel() >= thread->getLevel()))
+	link = &(*link)->nextInQueue;
+    thread->nextInQueue = *link;
+    *link = thread;
+    if (thread->nextInQueue == NULL)
+	last = thread;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::RemoveThread
+// 	Take "thread" off the queue, wherever it is.  Returns false if
+//	it was not on it.
+//----------------------------------------------------------------------
+
+bool
+ThreadQueue::RemoveThread(Thread *thread)
+{
+    Thread *prev = NULL;
+
+    for (Thread **link = &first; *link != NULL; link = &(*link)->nextInQueue) {
+	if (*link == thread) {
+	    *link = thread->nextInQueue;
+	    if (last == thread)
+		last = prev;
+	    thread->nextInQueue = NULL;
+	    return true;
+	}
+	prev = *link;
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------
+// ThreadQueue::Apply
+// 	Call "func" on each thread of the queue, in order.
+//----------------------------------------------------------------------
+
+void
+ThreadQueue::Apply(void (*func)(Thread*))
+{
+    for (Thread *thread = first; thread != NULL; thread = thread->nextInQueue)
+	func(thread);
+}
@@ -50,7 +50,7 @@
 
 #endif
 
-class Puerto;
+class Lock;
 
 // CPU register state to be saved on context switch.  
 // x86 processors needs 9 32-bit registers, whereas x64 has 8 extra registers
@@ -85,7 +85,8 @@ class Thread {
     HostMemoryAddress machineState[MachineStateSize];	// all registers except for stackTop
 
   public:
-    Thread(const char* debugName, int threadPriority);	// initialize a Thread 
+    Thread(const char* debugName, int threadPriority,
+	   bool isJoinable = false);	// initialize a Thread 
     ~Thread(); 				// deallocate a Thread
 					        // NOTE -- thread being deleted
 					        // must not be running when delete 
@@ -100,16 +101,32 @@ class Thread {
 						                        // relinquish the processor
     void Finish(int eCode = 0); 	                // The thread is done executing
     int  Join();				                // Locks the caller until 
-						                        // this thread end
+						                        // this thread end, and
+						                        // deletes it
+    void Reclaim();				                // Free the stack and the
+						                        // address space
+    void Detach();				                // Nobody will join it
+    bool isJoinable() { return joinable; }
+    Thread *getParent() { return parent; }
+    void setParent(Thread *t) { parent = t; }
     void CheckOverflow();   			            // Check if thread has 
 						                            // overflowed its 
     void setStatus(ThreadStatus st) { status = st; }
     const char* getName() { return (name); }
     void Print() { printf("%s, ", name); }
     int getPriority() { return priority; }
+    int getLevel()			// ready queue it goes to
+	{ return level > donated ? level : donated; }
+    int getOwnLevel() { return level; }	// without the donations
+    void setLevel(int newLevel) { level = newLevel; }
+    void setDonated(int newDonated) { donated = newDonated; }
+    ThreadStatus getStatus() { return status; }
     
     int exitCode;   // Usado para retornar valores
 
+    Lock *waitingFor;	// Lock it is blocked on, if any
+    Lock *locksHeld;	// Locks it holds, chained by Lock::nextHeld
+
     OpenFileId getFileDescriptor(OpenFile *fd); // Agregar un archivo abierto al arreglo
     OpenFile *getOpenFile(OpenFileId fd);  // Obtener referencia a un archivo abierto
     int freeFileDescriptor(OpenFileId fd);      // Saca al archivo de la lista de abiertos
@@ -125,10 +142,20 @@ class Thread {
 
     void StackAllocate(VoidFunctionPtr func, void* arg); // Allocate a stack for thread.
     										             // Used internally by Fork()
-    Puerto *port;			// Port used to comunicate 
-					        // between threads when Join is called
+    bool joinable;			// Is it kept after finishing,
+					        // until Join is called?
+    bool finished;			// Has it called Finish?
+    Thread *joiner;			// Thread blocked in Join, if any
+    Thread *parent;			// Thread that may join it, if any
     OpenFile *openFiles[MAX_FD];   // Arreglo de archivos abiertos
     int priority;       // Priority used by the scheduler
+    int level;          // Current level, around the priority (see
+                        // Scheduler::QuantumExpired)
+    int donated;        // Highest level of the threads waiting for its
+                        // locks, -1 if none (see Lock::Acquire)
+    Thread *nextInQueue;    // Next in the ThreadQueue it is on, if any
+
+    friend class ThreadQueue;
 
 #ifdef USER_PROGRAM
 // A thread running a user program actually has *two* sets of CPU registers -- 
@@ -145,6 +172,29 @@ class Thread {
 #endif
 };
 
+// The following class defines a FIFO queue of threads, linked through
+// the threads themselves, so that putting a thread on it and taking it
+// off allocate nothing.  A thread is on at most one of them: the ready
+// list of its level, or the queue of what it is blocked on.
+
+class ThreadQueue {
+  public:
+    ThreadQueue() { first = last = NULL; }
+
+    bool IsEmpty() { return first == NULL; }
+    Thread *Peek() { return first; }	// NULL if empty
+    void Append(Thread *thread);
+    Thread *Remove();			// NULL if empty
+    void InsertByLevel(Thread *thread);	// after the ones at its level
+					// or above
+    bool RemoveThread(Thread *thread);	// false if it was not there
+    void Apply(void (*func)(Thread*));
+
+  private:
+    Thread *first;
+    Thread *last;
+};
+
 // Magical machine-dependent routines, defined in switch.s
 
 extern "C" {
@@ -14,6 +14,11 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "heap.h"
+#include "synch.h"
+
+#include <sys/time.h>		// for gettimeofday
+#include <sys/resource.h>	// for getrusage
 
 #define KNRM  "\x1B[0m"
 #define KRED  "\x1B[31m"
@@ -80,7 +85,7 @@ ThreadTest()
         char *name = new char[8];
         sprintf(name, "H%dP%d", i, p);
 
-        myThreads[i] = new Thread (name, p);
+        myThreads[i] = new Thread (name, p, true);
         myThreads[i]->Fork (SimpleThread, (void*)name);
     }
 
@@ -96,3 +101,528 @@ ThreadTest()
     printf(KRED "Los hijos ya deberian haber terminado\n" RESET);
 
 }
+
+//----------------------------------------------------------------------
+// HostSeconds
+// 	Host (not simulated) time, in seconds, for the benchmarks below.
+//----------------------------------------------------------------------
+
+static double
+HostSeconds()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+//----------------------------------------------------------------------
+// HostCPUSeconds
+// 	Host CPU time used by Nachos so far (user and system), in
+//	seconds: what the time slicing of -p measures.
+//----------------------------------------------------------------------
+
+static double
+HostCPUSeconds()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0
+	+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+//----------------------------------------------------------------------
+// QueueBenchmark
+// 	Compare the heap used for the pending interrupts against the
+//	sorted list of pointers it replaced, with the "hold" model: the
+//	queue holds "size" events, and each step takes off the earliest
+//	one and schedules a new one a random time after it.  A second
+//	round moves events instead (cancel and schedule again), as a
+//	device would when its timing changes.
+//
+//	The list side allocates a PendingInterrupt per event, as
+//	Interrupt::Schedule used to.
+//----------------------------------------------------------------------
+
+static void
+QueueBenchmark()
+{
+    const int steps = 200000;
+    int sizes[] = { 4, 16, 64, 256 };
+
+    RandomInit(1);
+    printf("%6s %12s %12s %12s %12s\n", "events", "list hold", "heap hold",
+	   "list move", "heap move");
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+	int size = sizes[s];
+	List<PendingInterrupt*> list;
+	Heap<PendingInterrupt> heap;
+	PendingInterrupt **listed = new PendingInterrupt*[size];
+	unsigned *handles = new unsigned[size];
+	PendingInterrupt *old, event;
+	double start, listHold, heapHold, listMove, heapMove;
+	int when, i, n;
+
+	for (i = 0; i < size; i++) {
+	    when = Random() % 1000;
+	    listed[i] = new PendingInterrupt(NULL, NULL, when, TimerInt);
+	    list.SortedInsert(listed[i], when);
+	    handles[i] = heap.Insert(PendingInterrupt(NULL, NULL, when,
+						      TimerInt), when);
+	}
+
+	start = HostSeconds();
+	for (n = 0; n < steps; n++) {
+	    old = list.SortedRemove(&when);
+	    delete old;
+	    when += 1 + Random() % 1000;
+	    list.SortedInsert(new PendingInterrupt(NULL, NULL, when, TimerInt),
+			      when);
+	}
+	listHold = HostSeconds() - start;
+
+	start = HostSeconds();
+	for (n = 0; n < steps; n++) {
+	    heap.RemoveMin(&event, &when);
+	    when += 1 + Random() % 1000;
+	    event.when = when;
+	    heap.Insert(event, when);
+	}
+	heapHold = HostSeconds() - start;
+
+	// Rebuild both queues with known members, so they can be moved
+	while ((old = list.SortedRemove(NULL)) != NULL)
+	    delete old;
+	while (heap.RemoveMin(NULL, NULL))
+	    ;
+	for (i = 0; i < size; i++) {
+	    when = Random() % 1000;
+	    listed[i] = new PendingInterrupt(NULL, NULL, when, TimerInt);
+	    list.SortedInsert(listed[i], when);
+	    handles[i] = heap.Insert(*listed[i], when);
+	}
+
+	start = HostSeconds();
+	for (n = 0; n < steps; n++) {
+	    i = Random() % size;
+	    list.RemItem(listed[i]);
+	    listed[i]->when += 1 + Random() % 1000;
+	    list.SortedInsert(listed[i], listed[i]->when);
+	}
+	listMove = HostSeconds() - start;
+
+	start = HostSeconds();
+	for (n = 0; n < steps; n++) {
+	    i = Random() % size;
+	    heap.Cancel(handles[i], &event);
+	    event.when += 1 + Random() % 1000;
+	    handles[i] = heap.Insert(event, event.when);
+	}
+	heapMove = HostSeconds() - start;
+
+	printf("%6d %10.0fns %10.0fns %10.0fns %10.0fns\n", size,
+	       listHold * 1e9 / steps, heapHold * 1e9 / steps,
+	       listMove * 1e9 / steps, heapMove * 1e9 / steps);
+
+	while ((old = list.SortedRemove(NULL)) != NULL)
+	    delete old;
+	delete [] listed;
+	delete [] handles;
+    }
+}
+
+//----------------------------------------------------------------------
+// Spin
+// 	Busy loop of "arg" iterations, that never yields the CPU, for
+//	PreemptBenchmark.  Signals "spinDone" when finished.
+//----------------------------------------------------------------------
+
+static Semaphore *spinDone;
+static volatile unsigned spinSum;
+
+static void
+Spin(void *arg)
+{
+    long iterations = (long) arg;
+
+    for (long i = 0; i < iterations; i++)
+	spinSum = spinSum * 31 + i;
+    spinDone->V();
+}
+
+//----------------------------------------------------------------------
+// SpinThreads
+// 	Run "count" threads that spin "iterations" times each, and wait
+//	for all of them.  Returns the host seconds it took, and the host
+//	CPU seconds in "cpu".
+//----------------------------------------------------------------------
+
+static double
+SpinThreads(int count, long iterations, double *cpu)
+{
+    double start = HostSeconds();
+    double startCPU = HostCPUSeconds();
+
+    for (int i = 0; i < count; i++)
+	(new Thread("spin", currentThread->getPriority()))->Fork(Spin,
+							(void *) iterations);
+    for (int i = 0; i < count; i++)
+	spinDone->P();
+    *cpu = HostCPUSeconds() - startCPU;
+    return HostSeconds() - start;
+}
+
+//----------------------------------------------------------------------
+// PreemptBenchmark
+// 	Cost of the time slicing of kernel threads (-p): the same CPU
+//	bound threads run without it, and then with shorter and shorter
+//	time slices.  The threads never yield, so without time slicing
+//	each one runs to the end before the next starts.
+//
+//	The host only checks its CPU timers on its clock tick (every
+//	4 ms on many Linux kernels), so a shorter slice than that lasts
+//	a whole tick anyway.  Next to the slice that was asked for, the
+//	table shows the one that was achieved: CPU time per preemption.
+//
+//	Nachos must not be running with -p, since only one time slicing
+//	can be active.
+//----------------------------------------------------------------------
+
+static void
+PreemptBenchmark()
+{
+    const int spinners = 4;
+    const long iterations = 50000000;
+    unsigned long slices[] = { 100000, 10000, 1000, 100 };
+    double base, cpu;
+
+    if (preemptiveScheduler != NULL) {
+	printf("Run the preempt benchmark without -p\n");
+	return;
+    }
+    spinDone = new Semaphore("spin done", 0);
+    base = SpinThreads(spinners, iterations, &cpu);
+    printf("%10s %10s %12s %10s %10s\n", "slice", "seconds", "preemptions",
+	   "achieved", "overhead");
+    printf("%10s %9.3fs %12d %10s %10s\n", "none", base, 0, "-", "-");
+    for (unsigned s = 0; s < sizeof(slices) / sizeof(slices[0]); s++) {
+	PreemptiveScheduler *slicing = new PreemptiveScheduler();
+	double seconds;
+
+	slicing->SetUp(slices[s]);
+	seconds = SpinThreads(spinners, iterations, &cpu);
+	printf("%8luus %9.3fs %12d", slices[s], seconds,
+	       slicing->Preemptions());
+	if (slicing->Preemptions() > 0)
+	    printf(" %8.0fus", cpu * 1000000 / slicing->Preemptions());
+	else
+	    printf(" %10s", "-");
+	printf(" %9.1f%%\n", (seconds - base) * 100 / base);
+	delete slicing;
+    }
+    delete spinDone;
+}
+
+//----------------------------------------------------------------------
+// Busy
+// 	Use the CPU for "ticks" simulated ticks, letting the timer in
+//	between (as kernel code with interrupts enabled would).
+//----------------------------------------------------------------------
+
+static void
+Busy(int ticks)
+{
+    for (int i = 0; i < ticks; i++) {
+	interrupt->SetLevel(IntOff);
+	interrupt->SetLevel(IntOn);
+    }
+}
+
+//----------------------------------------------------------------------
+// Priority inversion
+// 	A low priority thread takes the mutex and works while holding
+//	it; then a high priority thread wants the mutex, while medium
+//	priority threads are using the CPU.  The mutex is a Lock (with
+//	priority inheritance) or a Semaphore (without it), and the high
+//	priority thread measures how many ticks it waited for it.
+//----------------------------------------------------------------------
+
+static const int holdTicks = 500;	// low works with the mutex held
+static const int mediumTicks = 5000;	// each medium thread works
+static const int mediums = 3;
+
+static Lock *invLock;
+static Semaphore *invSem;		// mutex when invLock is NULL
+static Semaphore *invHeld, *invDone;
+static int invWait;
+
+static void
+InversionLow(void *arg)
+{
+    if (invLock != NULL)
+	invLock->Acquire();
+    else
+	invSem->P();
+    invHeld->V();
+    Busy(holdTicks);
+    if (invLock != NULL)
+	invLock->Release();
+    else
+	invSem->V();
+    invDone->V();
+}
+
+static void
+InversionMedium(void *arg)
+{
+    Busy(mediumTicks);
+    invDone->V();
+}
+
+static void
+InversionHigh(void *arg)
+{
+    int start = stats->totalTicks;
+
+    if (invLock != NULL)
+	invLock->Acquire();
+    else
+	invSem->P();
+    invWait = stats->totalTicks - start;
+    if (invLock != NULL)
+	invLock->Release();
+    else
+	invSem->V();
+    invDone->V();
+}
+
+//----------------------------------------------------------------------
+// InversionRound
+// 	One round with "lock" as the mutex (a Semaphore if NULL).
+//	Returns the ticks the high priority thread waited.
+//----------------------------------------------------------------------
+
+static int
+InversionRound(Lock *lock)
+{
+    invLock = lock;
+    invSem = new Semaphore("inversion mutex", 1);
+    invHeld = new Semaphore("inversion held", 0);
+    invDone = new Semaphore("inversion done", 0);
+
+    (new Thread("low", 1))->Fork(InversionLow, NULL);
+    invHeld->P();				// low holds the mutex
+    for (int i = 0; i < mediums; i++)
+	(new Thread("medium", 4))->Fork(InversionMedium, NULL);
+    (new Thread("high", MAX_PRIORITY - 1))->Fork(InversionHigh, NULL);
+    for (int i = 0; i < mediums + 2; i++)
+	invDone->P();
+
+    delete invSem;
+    delete invHeld;
+    delete invDone;
+    return invWait;
+}
+
+//----------------------------------------------------------------------
+// InversionRounds
+// 	Run the rounds, from a thread above the medium ones so that the
+//	rounds are set up as planned, and print the waits.
+//----------------------------------------------------------------------
+
+static void
+InversionRounds(void *arg)
+{
+    const int rounds = 5;
+    Lock *lock = new Lock("inversion lock");
+    int worst[2] = { 0, 0 }, total[2] = { 0, 0 };
+
+    for (int r = 0; r < rounds; r++)
+	for (int inherit = 0; inherit < 2; inherit++) {
+	    int wait = InversionRound(inherit ? lock : NULL);
+
+	    total[inherit] += wait;
+	    if (wait > worst[inherit])
+		worst[inherit] = wait;
+	}
+    printf("%d ticks held, %d medium threads of %d ticks\n", holdTicks,
+	   mediums, mediumTicks);
+    printf("%-20s %10s %10s\n", "high priority wait", "mean", "worst");
+    printf("%-20s %10d %10d\n", "semaphore", total[0] / rounds, worst[0]);
+    printf("%-20s %10d %10d\n", "lock (inheritance)", total[1] / rounds,
+	   worst[1]);
+    delete lock;
+    ((Semaphore *) arg)->V();
+}
+
+//----------------------------------------------------------------------
+// InversionBenchmark
+// 	Ticks that the high priority thread waits for the mutex, with
+//	and without priority inheritance.  Without it, the low priority
+//	thread only runs again when the medium ones stop, and the wait
+//	grows with their work; with it, the wait is bounded by the
+//	time the mutex is held.
+//----------------------------------------------------------------------
+
+static void
+InversionBenchmark()
+{
+    Semaphore *finished = new Semaphore("inversion finished", 0);
+
+    (new Thread("inversion", MAX_PRIORITY - 2))->Fork(InversionRounds,
+						      finished);
+    finished->P();
+    delete finished;
+}
+
+//----------------------------------------------------------------------
+// Ping-pong
+// 	Two threads pass a message back and forth, through a pair of
+//	Puertos (lock and conditions) or of semaphores, so each message
+//	blocks one thread and wakes up the other.
+//----------------------------------------------------------------------
+
+static const int pingPongMessages = 1000000;
+
+static Puerto *pingPort, *pongPort;
+static Semaphore *pingSem, *pongSem;
+
+static void
+PongPorts(void *arg)
+{
+    int msg;
+
+    for (int i = 0; i < pingPongMessages / 2; i++) {
+	pingPort->Recv(&msg);
+	pongPort->Send(msg + 1);
+    }
+}
+
+static void
+PongSemaphores(void *arg)
+{
+    for (int i = 0; i < pingPongMessages / 2; i++) {
+	pingSem->P();
+	pongSem->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// PingPongBenchmark
+// 	Host time per message passed, with each kind of pair.
+//----------------------------------------------------------------------
+
+static void
+PingPongBenchmark()
+{
+    double start, ports, semaphores;
+    int msg = 0;
+
+    pingPort = new Puerto("ping");
+    pongPort = new Puerto("pong");
+    start = HostSeconds();
+    (new Thread("pong", currentThread->getPriority()))->Fork(PongPorts, NULL);
+    for (int i = 0; i < pingPongMessages / 2; i++) {
+	pingPort->Send(msg);
+	pongPort->Recv(&msg);
+    }
+    ports = HostSeconds() - start;
+    ASSERT(msg == pingPongMessages / 2);
+    delete pingPort;
+    delete pongPort;
+
+    pingSem = new Semaphore("ping", 0);
+    pongSem = new Semaphore("pong", 0);
+    start = HostSeconds();
+    (new Thread("pong", currentThread->getPriority()))->Fork(PongSemaphores,
+							     NULL);
+    for (int i = 0; i < pingPongMessages / 2; i++) {
+	pingSem->V();
+	pongSem->P();
+    }
+    semaphores = HostSeconds() - start;
+    delete pingSem;
+    delete pongSem;
+
+    printf("%d messages\n", pingPongMessages);
+    printf("%-12s %9.3fs %8.0fns/message\n", "puertos", ports,
+	   ports * 1e9 / pingPongMessages);
+    printf("%-12s %9.3fs %8.0fns/message\n", "semaphores", semaphores,
+	   semaphores * 1e9 / pingPongMessages);
+}
+
+//----------------------------------------------------------------------
+// Nothing
+// 	Body of the threads of ThreadsBenchmark.
+//----------------------------------------------------------------------
+
+static void
+Nothing(void *arg)
+{
+}
+
+//----------------------------------------------------------------------
+// ThreadsBenchmark
+// 	Host time to create a thread, run it and tear it down, when
+//	nobody joins it (it is deleted as soon as it finishes) and when
+//	it is joined.
+//----------------------------------------------------------------------
+
+static void
+ThreadsBenchmark()
+{
+    const int count = 200000;
+    int priority = currentThread->getPriority();
+    double start, detached, joined;
+
+    start = HostSeconds();
+    for (int i = 0; i < count; i++) {
+	(new Thread("detached", priority))->Fork(Nothing, NULL);
+	currentThread->Yield();			// it runs and finishes
+    }
+    detached = HostSeconds() - start;
+
+    start = HostSeconds();
+    for (int i = 0; i < count; i++) {
+	Thread *thread = new Thread("joined", priority, true);
+
+	thread->Fork(Nothing, NULL);
+	thread->Join();
+    }
+    joined = HostSeconds() - start;
+
+    printf("%d threads\n", count);
+    printf("%-10s %9.3fs %8.0fns/thread\n", "detached", detached,
+	   detached * 1e9 / count);
+    printf("%-10s %9.3fs %8.0fns/thread\n", "joined", joined,
+	   joined * 1e9 / count);
+}
+
+//----------------------------------------------------------------------
+// Benchmark
+// 	Run the benchmark called "name" (nachos -B <name>).
+//
+//	"queue" -- pending interrupt heap against the sorted list
+//	"preempt" -- overhead of the time slicing of kernel threads (-p)
+//	"inversion" -- priority inversion, with and without inheritance
+//	"pingpong" -- blocking and waking up threads
+//	"threads" -- creating and tearing down threads
+//----------------------------------------------------------------------
+
+void
+Benchmark(const char *name)
+{
+    if (!strcmp(name, "queue"))
+	QueueBenchmark();
+    else if (!strcmp(name, "preempt"))
+	PreemptBenchmark();
+    else if (!strcmp(name, "inversion"))
+	InversionBenchmark();
+    else if (!strcmp(name, "pingpong"))
+	PingPongBenchmark();
+    else if (!strcmp(name, "threads"))
+	ThreadsBenchmark();
+    else
+	printf("Unknown benchmark \"%s\"\n", name);
+}
@@ -19,7 +19,6 @@
 #include "system.h"
 #include "readwrite.h"
 #include "addrspace.h"
-#include "noff.h"
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -43,6 +42,57 @@ SwapHeader (NoffHeader *noffH)
 	noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
 }
 
+//----------------------------------------------------------------------
+// LoadSegment
+// 	Copy into "page" (the frame holding virtual page "vpn") the part
+//	of segment "seg" that falls in that page, if any, with a single
+//	read of the executable.  With "count" > 1, "page" is a buffer
+//	for that many pages, starting at "vpn".
+//----------------------------------------------------------------------
+
+static void
+LoadSegment(OpenFile *executable, Segment *seg, int vpn, char *page,
+	    int count = 1)
+{
+    int start = vpn * PageSize;
+    int from = seg->virtualAddr > start ? seg->virtualAddr : start;
+    int to = seg->virtualAddr + seg->size;
+
+    if (to > start + count * PageSize)
+	to = start + count * PageSize;
+    if (from < to)
+	executable->ReadAt(page + (from - start), to - from,
+			   seg->inFileAddr + (from - seg->virtualAddr));
+}
+
+#ifdef USE_TLB
+// El espacio dueño de cada ASID: el único que puede tener entradas con
+// ese ASID en la TLB. Si hay más espacios que ASIDs, se los van quitando
+// al correr (RestoreState)
+static AddrSpace *asidOwner[NumASIDs];
+static int nextASID = 0;
+
+//----------------------------------------------------------------------
+// NewASID
+//  Un ASID para un espacio nuevo: el siguiente libre, o si no hay, el
+//  siguiente (que se compartirá con su dueño)
+//----------------------------------------------------------------------
+
+static int
+NewASID()
+{
+    int asid = nextASID;
+
+    for (int i = 0; i < NumASIDs; i++)
+        if (asidOwner[(nextASID + i) % NumASIDs] == NULL) {
+            asid = (nextASID + i) % NumASIDs;
+            break;
+        }
+    nextASID = (asid + 1) % NumASIDs;
+    return asid;
+}
+#endif
+
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space to run a user program.
@@ -55,13 +105,28 @@ SwapHeader (NoffHeader *noffH)
 //	memory.  For now, this is really simple (1:1), since we are
 //	only uniprogramming, and we have a single unsegmented page table
 //
+//	With DEMAND_LOADING, no page is loaded here: every page starts
+//	without a frame, and is loaded by the page fault handler the
+//	first time it is touched (see PageIn).
+//
+//	With VM, the pages that hold only code are read-only, and shared
+//	with every other address space running the same executable.
+//
+//	The address space keeps "executable" open, and closes it when it
+//	is deallocated.
+//
 //	"executable" is the file containing the object code to load into memory
 //----------------------------------------------------------------------
 
 AddrSpace::AddrSpace(OpenFile *executable, int id) {
     pid = id;
+#ifdef USE_TLB
+    asid = NewASID();
+#endif
+    exeFile = executable;
+    exeUsers = new int;
+    *exeUsers = 1;
     
-    NoffHeader noffH;
     unsigned int size;
 
     executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
@@ -70,15 +135,6 @@ AddrSpace::AddrSpace(OpenFile *executable, int id) {
     	SwapHeader(&noffH);
     ASSERT(noffH.noffMagic == NOFFMAGIC);
 
-#ifdef VM
-    char swapFilename[32];
-    sprintf(swapFilename, "SWAP.%d", pid);
-    DEBUG('a', "----- Creating swap file: %s\n", swapFilename);
-    ASSERT(fileSystem->Create(swapFilename, MemorySize));
-    swap = fileSystem->Open(swapFilename);
-#endif
-
-
 // how big is address space?
     size = noffH.code.size + noffH.initData.size + noffH.uninitData.size 
 			+ UserStackSize;	// we need to increase the size
@@ -88,92 +144,307 @@ AddrSpace::AddrSpace(OpenFile *executable, int id) {
 
 #ifndef VM
     ASSERT(numPages <= NumPhysPages);
+#else
+    swapSlot = new int[numPages];
+    cow = new bool[numPages];
+    cowNext = new AddrSpace *[numPages];
+    window = 1;
+    nextFault = -1;
+    resident = 0;
+    cpuTicks = lastFault = 0;
+    runSince = stats->userTicks;
+    faultTime = stats->totalTicks;
+    coremap->Admit(this);
+
+    // las páginas enteras de código, si empieza en 0 (siempre)
+    int textPages = 0;
+    if (noffH.code.virtualAddr == 0)
+        textPages = noffH.code.size / PageSize;
+    text = NULL;
+    if (textPages > 0)
+        text = coremap->AttachText(this, executable->Identity(), textPages);
 #endif
 
     DEBUG('a', "----- Initializing address space, num pages %d, size %d\n", 
 			numPages, size);
-// first, set up the translation
+    DEBUG('a', "----- Code segment at 0x%x, size %d\n", 
+			noffH.code.virtualAddr, noffH.code.size);
+    DEBUG('a', "----- Data segment at 0x%x, size %d\n", 
+			noffH.initData.virtualAddr, noffH.initData.size);
+
+// set up the translation, and load each page (code, data, or zeroes)
     pageTable = new TranslationEntry[numPages];
     
     for (unsigned int i=0; i < numPages; i++) {
 	    pageTable[i].virtualPage = i;
-#ifndef VM
-        pageTable[i].physicalPage = memPages->Find();
-        ASSERT(pageTable[i].physicalPage != -1);
-#else 
-        pageTable[i].physicalPage = coremap->Find(this, GetEntry(i));
-#endif
-        pageTable[i].valid = true;
+	    pageTable[i].valid = true;
 	    pageTable[i].use = false;
 	    pageTable[i].dirty = false;
 	    pageTable[i].readOnly = false;  
-        
-        bzero(&(machine->mainMemory[pageTable[i].physicalPage*PageSize]), PageSize);
-    }
-    
-    char byte;
-    int addr, frame, offset;
-
-// then, copy in the code and data segments into memory
-    if (noffH.code.size > 0) {
-        DEBUG('a', "----- Initializing code segment, at 0x%x, size %d\n", 
-                noffH.code.virtualAddr, noffH.code.size);
-        for (int i=0; i<noffH.code.size; i++){
-            
-            executable->ReadAt(&byte, 1, noffH.code.inFileAddr+i);
-            addr = noffH.code.virtualAddr + i;
-            frame = pageTable[addr/PageSize].physicalPage;
 #ifndef VM
-            ASSERT(frame >= 0);
+        pageTable[i].physicalPage = memPages->Find();
+        ASSERT(pageTable[i].physicalPage != -1);
+        LoadPage(i, pageTable[i].physicalPage);
 #else 
-            if (frame < 0) {
-                frame = coremap->Find(this, GetEntry(addr/PageSize));
-                SwapIn(addr/PageSize, frame);
-            }
+        swapSlot[i] = -1;
+        cow[i] = false;
+        cowNext[i] = NULL;
+        pageTable[i].readOnly = (i < (unsigned) textPages);
+        pageTable[i].physicalPage = -1;     // se carga cuando se la toque
+#ifndef DEMAND_LOADING
+        if (pageTable[i].physicalPage == -1)    // no la trajo la anterior
+            PageIn(i);
+#endif
 #endif
-            offset = addr%PageSize;
-            machine->mainMemory[frame*PageSize+offset] = byte;
-        }
-    
     }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddrSpace
+// 	Create an address space for a Fork of "parent": a copy of it,
+//	running the same executable.
+//
+//	With VM, nothing is copied yet.  Code pages are shared as usual.
+//	Every other page that is in memory is shared with the parent,
+//	read-only for both, until one of them writes it (CopyOnWrite).
+//	The pages that the parent has in swap are copied to new swap
+//	slots of the child, and the ones it never touched are left to be loaded
+//	from the executable.
+//
+//	Without VM, every page is copied to a new frame.
+//----------------------------------------------------------------------
+
+AddrSpace::AddrSpace(AddrSpace *parent, int id) {
+    pid = id;
+#ifdef USE_TLB
+    asid = NewASID();
+#endif
+    exeFile = parent->exeFile;
+    exeUsers = parent->exeUsers;
+    (*exeUsers)++;
+    noffH = parent->noffH;
+    numPages = parent->numPages;
+    pageTable = new TranslationEntry[numPages];
 
-    if (noffH.initData.size > 0) {
-        DEBUG('a', "----- Initializing data segment, at 0x%x, size %d\n", 
-                noffH.initData.virtualAddr, noffH.initData.size);
-        for (int i=0; i<noffH.initData.size; i++){
-            executable->ReadAt(&byte, 1, noffH.initData.inFileAddr+i);
-            addr = noffH.initData.virtualAddr + i;
-            frame = pageTable[addr/PageSize].physicalPage;
 #ifndef VM
-            ASSERT(frame >= 0);
-#else 
-            if (frame < 0) {
-                frame = coremap->Find(this, GetEntry(addr/PageSize));
-                SwapIn(addr/PageSize, frame);
+    for (unsigned int i=0; i < numPages; i++) {
+        pageTable[i] = parent->pageTable[i];
+        pageTable[i].physicalPage = memPages->Find();
+        ASSERT(pageTable[i].physicalPage != -1);
+        memcpy(&machine->mainMemory[pageTable[i].physicalPage * PageSize],
+               &machine->mainMemory[parent->pageTable[i].physicalPage * PageSize],
+               PageSize);
+        machine->InvalidateDecodedPage(pageTable[i].physicalPage);
+    }
+#else
+    swapSlot = new int[numPages];
+    cow = new bool[numPages];
+    cowNext = new AddrSpace *[numPages];
+    window = 1;
+    nextFault = -1;
+    resident = 0;
+    cpuTicks = lastFault = 0;
+    runSince = stats->userTicks;
+    faultTime = stats->totalTicks;
+    coremap->Admit(this);
+    text = NULL;
+    if (parent->text)
+        text = coremap->AttachText(this, parent->text->fileId,
+                                   parent->text->numPages);
+
+#ifdef USE_TLB
+    // los bits de la TLB al día en la tabla del padre, y que el padre
+    // vuelva a cargar sus páginas, ahora de sólo lectura
+    ASSERT(currentThread->space == parent);
+    parent->FlushTLBEntries();
+#endif
+
+    for (unsigned int i=0; i < numPages; i++) {
+        TranslationEntry *entry = &pageTable[i];
+        char page[PageSize];
+        bool load;
+
+        *entry = parent->pageTable[i];
+        swapSlot[i] = -1;
+        cow[i] = false;
+        cowNext[i] = NULL;
+        if (entry->physicalPage != -1) {
+            if (text && i < (unsigned) text->numPages)
+                coremap->MapText(text, this, entry, &load);
+            else {
+                coremap->Share(entry->physicalPage, this, entry);
+                resident++;
+                // la copia del padre en swap no es nuestra: si se
+                // desaloja, hay que escribirla
+                entry->dirty = entry->dirty || parent->swapSlot[i] != -1;
+                entry->readOnly = parent->pageTable[i].readOnly = true;
+                cow[i] = parent->cow[i] = true;
             }
+        } else if (parent->swapSlot[i] != -1) {
+            swapSlot[i] = NewSwapSlot(i);
+            swapFile->ReadAt(page, PageSize, parent->swapSlot[i] * PageSize);
+            swapFile->WriteAt(page, PageSize, swapSlot[i] * PageSize);
+        }
+    }
 #endif
-            offset = addr%PageSize;
-            machine->mainMemory[frame*PageSize+offset] = byte;
+    DEBUG('a', "----- Address space %d forked from %d, num pages %d\n",
+            pid, parent->pid, numPages);
+}
+
+#ifdef VM
+//----------------------------------------------------------------------
+// AddrSpace::NewSwapSlot
+//  Un lugar libre en el área de swap, compartida por todos los
+//  procesos, para la página vpn. El archivo se crea la primera vez
+//  que se desaloja una página, y crece a medida que se usan más
+//  lugares.
+//
+//  Si está libre, se usa el lugar que sigue al de la página anterior:
+//  así las páginas seguidas quedan seguidas en el swap, y un fallo
+//  las puede traer juntas (FaultAround).
+//----------------------------------------------------------------------
+int AddrSpace::NewSwapSlot(int vpn) {
+    if (swapFile == NULL) {
+        DEBUG('a', "----- Creating swap file: %s\n", SWAP_FILE);
+        ASSERT(fileSystem->Create(SWAP_FILE, 0));
+        swapFile = fileSystem->Open(SWAP_FILE);
+    }
+    int slot = vpn > 0 ? swapSlot[vpn - 1] + 1 : 0;
+
+    if (slot > 0 && slot < SWAP_PAGES && !swapSlots->Test(slot))
+        swapSlots->Mark(slot);
+    else
+        slot = swapSlots->Find();
+    ASSERT(slot != -1);     // no queda lugar en el swap
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FaultAround
+//  Al fallo en la página vpn se le suman las páginas que la siguen y
+//  tampoco están en memoria, mientras haya marcos libres de sobra y
+//  se puedan leer con la misma lectura: todas del ejecutable (o en
+//  cero), o todas del swap, en lugares seguidos.
+//
+//  Cuántas se intentan traer se adapta a los fallos: si el fallo es
+//  justo después de las páginas que trajo el anterior, el recorrido
+//  es secuencial y la ventana se duplica (hasta FAULT_AROUND); si no,
+//  vuelve a una sola página.
+//
+//  Deja en frames los marcos de las páginas que siguen a vpn, fijados,
+//  y devuelve cuántas son.
+//----------------------------------------------------------------------
+int AddrSpace::FaultAround(int vpn, int *frames) {
+    if (vpn == nextFault)
+        window = window * 2 > FAULT_AROUND ? FAULT_AROUND : window * 2;
+    else
+        window = 1;
+
+    int count = 0;
+    for (int page = vpn + 1; page < vpn + window; page++) {
+        if ((unsigned) page >= numPages || resident >= allowance
+            || pageTable[page].physicalPage != -1)
+            break;
+        if (swapSlot[vpn] == -1 ? swapSlot[page] != -1
+                                : swapSlot[page] != swapSlot[vpn] + page - vpn)
+            break;
+        // si el pager la desalojó pero sigue en su marco, alcanza con
+        // recuperarla (y no hay que leer una copia vieja)
+        int frame = coremap->Reclaim(this, NULL, &pageTable[page]);
+        if (frame != -1) {
+            pageTable[page].physicalPage = frame;
+            resident++;
+            break;
         }
-    
+        frame = coremap->FindFree(this, &pageTable[page]);
+        if (frame == -1)
+            break;
+        pageTable[page].physicalPage = frame;
+        resident++;
+        coremap->Pin(frame);
+        frames[count++] = frame;
     }
+    nextFault = vpn + 1 + count;
+    stats->numReadAheads += count;
+    return count;
+}
+#endif
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPage
+// 	Fill frame "physPage" with the initial contents of virtual page
+//	"vpn": the pieces of the code and initialized data segments that
+//	fall in it, and zeroes elsewhere (uninitialized data and stack).
+//----------------------------------------------------------------------
+
+void AddrSpace::LoadPage(int vpn, int physPage) {
+    LoadPages(vpn, 1, &physPage);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPages
+// 	Like LoadPage, for the "count" virtual pages starting at "vpn",
+//	going to frames "frames".  Each segment is read with a single
+//	read of the executable, into a buffer when there is more than one
+//	page.
+//----------------------------------------------------------------------
 
+void AddrSpace::LoadPages(int vpn, int count, int *frames) {
+    char buffer[FAULT_AROUND * PageSize];
+    char *pages = buffer;
+
+    ASSERT(count > 0 && count <= FAULT_AROUND);
+    if (count == 1)
+	pages = &machine->mainMemory[frames[0] * PageSize];
+    bzero(pages, count * PageSize);
+    LoadSegment(exeFile, &noffH.code, vpn, pages, count);
+    LoadSegment(exeFile, &noffH.initData, vpn, pages, count);
+    for (int i = 0; i < count; i++) {
+	if (count > 1)
+	    memcpy(&machine->mainMemory[frames[i] * PageSize],
+		   &buffer[i * PageSize], PageSize);
+	machine->InvalidateDecodedPage(frames[i]);
+    }
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.  Nothing for now!
+// 	Dealloate an address space.
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
-    for(unsigned int i=0; i<numPages; i++) 
+#ifdef USE_TLB
+    FlushTLBEntries();
+    if (asidOwner[asid] == this)
+        asidOwner[asid] = NULL;
+#endif
 #ifndef VM
+    for(unsigned int i=0; i<numPages; i++) 
         memPages->Clear(pageTable[i].physicalPage);
 #else
-        coremap->Clear(pageTable[i].physicalPage);
+    unsigned int first = 0;     // primera página propia
+    if (text) {
+        first = text->numPages;
+        coremap->DetachText(text, this);
+    }
+    for(unsigned int i=first; i<numPages; i++) 
+        if (pageTable[i].physicalPage != -1)
+            coremap->Unshare(pageTable[i].physicalPage, this, i);
+    coremap->Forget(this, NULL);
+    coremap->Leave(this);
+    for(unsigned int i=0; i<numPages; i++)
+        if (swapSlot[i] != -1)
+            swapSlots->Clear(swapSlot[i]);
+    delete [] swapSlot;
+    delete [] cow;
+    delete [] cowNext;
 #endif
     delete pageTable;
+    if (--(*exeUsers) == 0) {
+        delete exeFile;
+        delete exeUsers;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -213,20 +484,17 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	With a TLB, nothing: its entries stay there, tagged with our
+//	ASID, and keep the up to date use and dirty bits until they are
+//	replaced (see SaveTLBEntry) or flushed.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
 {
-    #ifdef USE_TLB
-    //También se podrían guardar las entradas válidas para volver a
-    //cargarlas a la vuelta
-    for (int i = 0;i < TLBSize; i++){
-        if(machine->tlb[i].valid)
-            currentThread->space->pageTable[machine->tlb[i].virtualPage] = machine->tlb[i];
-    }
-    #endif
-
+#ifdef VM
+    cpuTicks += stats->userTicks - runSince;    // lo que corrió esta vez
+    runSince = stats->userTicks;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -235,18 +503,29 @@ void AddrSpace::SaveState()
 //	this address space can run.
 //
 //      For now, tell the machine where to find the page table.
+//
+//	With a TLB, tell it our ASID instead, so the entries we left
+//	there the last time we ran are still good.  If another address
+//	space took the ASID meanwhile, its entries go first.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
     
     #ifdef USE_TLB
-    for (int i = 0; i < TLBSize; i++)
-        machine->tlb[i].valid = false;
+    if (asidOwner[asid] != this) {
+        if (asidOwner[asid] != NULL)
+            asidOwner[asid]->FlushTLBEntries();
+        asidOwner[asid] = this;
+    }
+    machine->SetASID(asid);
     #else
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
     #endif
+#ifdef VM
+    runSince = stats->userTicks;
+#endif
 }
 
 // Escribe los argumentos args en el espacio de memoria del proceso.
@@ -285,9 +564,11 @@ void AddrSpace::WriteArgs(char **args) {
     for (unsigned j = 0; j < argc; j++)
         // Guardamos la dirección del argumento j-ésimo desde atrás hacia
         // adelante.
-        machine->WriteMem(sp + 4 * j, 4, args_address[j]);
+        if (!machine->WriteMem(sp + 4 * j, 4, args_address[j]))
+            ASSERT(machine->WriteMem(sp + 4 * j, 4, args_address[j]));
     // El último es NULL.
-    machine->WriteMem(sp + 4 * argc, 4, 0);
+    if (!machine->WriteMem(sp + 4 * argc, 4, 0))
+        ASSERT(machine->WriteMem(sp + 4 * argc, 4, 0));
     // Dejamos lugar para los “register saves”.
     machine->WriteRegister(5, sp);       /* char **argv */
     sp -= 16;
@@ -302,35 +583,212 @@ void AddrSpace::WriteArgs(char **args) {
 #ifdef VM
 //----------------------------------------------------------------------
 // AddrSpace::SwapOut
+//  Si la página no se modificó desde que se cargó, su copia en swap
+//  (o en el ejecutable, si nunca pasó por el swap) es igual a la de
+//  memoria, y no hace falta escribirla.
 //----------------------------------------------------------------------
 void AddrSpace::SwapOut(int vpn) {
     int phys = pageTable[vpn].physicalPage;
+    bool dirty = pageTable[vpn].dirty;
+
+#ifdef USE_TLB
+    // si está en la TLB, el bit al día está ahí
+    int slot = TLBSlot(vpn);
+    if (slot >= 0 && machine->tlb[slot].dirty)
+        dirty = true;
+#endif
     
     // enviamos la página a disco
-    swap->WriteAt(&(machine->mainMemory[phys*PageSize]), PageSize, vpn*PageSize);
+    if (dirty) {
+        stats->numPageOuts++;
+        if (swapSlot[vpn] == -1)
+            swapSlot[vpn] = NewSwapSlot(vpn);
+        swapFile->WriteAt(&(machine->mainMemory[phys*PageSize]), PageSize,
+                          swapSlot[vpn] * PageSize);
+    }
+    machine->InvalidateDecodedPage(phys);
 
     // marcamos la página como inválida en la pageTable
     pageTable[vpn].physicalPage = -1;
+    resident--;
+    pageTable[vpn].dirty = false;
+    // la copia en swap ya es sólo nuestra
+    if (cow[vpn]) {
+        cow[vpn] = false;
+        pageTable[vpn].readOnly = false;
+    }
 
 #ifdef USE_TLB
-    // Si éste es el proceso actual, debo invalidar la entrada en la tlb
-    if(currentThread->space == this)
-        for(int i=0; i<TLBSize; i++)
-            if((machine->tlb[i].virtualPage == vpn) && machine->tlb[i].valid) 
-                machine->tlb[i].valid = false;
+    // invalidamos la entrada en la tlb, aunque no sea el proceso actual
+    if (asidOwner[asid] == this)
+        machine->InvalidateTLBPage(vpn, asid);
 #endif
     
-    DEBUG('a',"----- Page %d swapped to disk\n", vpn);
+    DEBUG('a',"----- Page %d %s\n", vpn,
+            dirty ? "swapped to disk" : "evicted clean");
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+//  Las páginas de código se comparten: si otro proceso ya la tiene en
+//  memoria, usamos ese marco. Si el pager la desalojó pero su marco
+//  todavía no se usó para otra, lo recuperamos. Si no, buscamos un
+//  marco y, si la página ya pasó por el swap la traemos de ahí; si no,
+//  nunca se modificó y la cargamos del ejecutable. Con la misma
+//  lectura se traen las páginas que siguen, si conviene (FaultAround).
+//  Los marcos quedan fijados mientras se llenan, por si la lectura se
+//  bloquea. Un proceso no pasa de las páginas que le asignó CoreMap:
+//  si ya las tiene, reemplaza una propia.
+//----------------------------------------------------------------------
+void AddrSpace::PageIn(int vpn) {
+    TranslationEntry *entry = GetEntry(vpn);
+    bool shared = text && vpn < text->numPages;
+    bool load = true;
+    int frame;
+
+    // un fallo del proceso (no la carga inicial, sin DEMAND_LOADING)
+    if (currentThread->space == this) {
+        CheckFaultRate();
+        // si ya tiene todas las páginas que le tocan, reemplaza una suya
+        while (!shared && resident >= allowance && coremap->Trim(this))
+            ;
+    }
+    if (shared)
+        frame = coremap->MapText(text, this, entry, &load);
+    else if ((frame = coremap->Reclaim(this, NULL, entry)) != -1)
+        load = false;   // el pager la desalojó, pero sigue en el marco
+    else
+        frame = coremap->Find(this, entry);
+    entry->physicalPage = frame;
+    if (!shared)
+        resident++;
+    if (!load) {
+        DEBUG('a',"----- Page %d found in frame %d\n", vpn, frame);
+        return;
+    }
+
+    int frames[FAULT_AROUND];
+    int count = 1;
+
+    frames[0] = frame;
+    coremap->Pin(frame);
+    if (!shared)
+        count += FaultAround(vpn, &frames[1]);
+    stats->numPageIns += count;
+    if (swapSlot[vpn] != -1)
+        SwapIn(vpn, count, frames);
+    else {
+        LoadPages(vpn, count, frames);
+        DEBUG('a',"----- Pages %d-%d loaded from executable\n", vpn,
+                vpn + count - 1);
+    }
+    // antes de soltar el marco: avisar puede bloquearnos, y el pager
+    // no debe llevársela antes de que la carguemos en la TLB
+    if (shared)                 // los que esperaban ya pueden usarla
+        coremap->TextLoaded(text, vpn);
+    for (int i = 0; i < count; i++) {
+        pageTable[vpn + i].dirty = false;   // igual a su copia
+        coremap->Unpin(frames[i]);
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CheckFaultRate
+//  Frecuencia de fallos de página (PFF), medida en los ticks de
+//  usuario del proceso: si falla muy seguido y ya usa todos sus
+//  marcos, necesita los que trae un fallo (y si no entran, CoreMap lo
+//  suspende); si falla poco, le sobra alguno.
+//----------------------------------------------------------------------
+void AddrSpace::CheckFaultRate() {
+    int now = VirtualTime();
+    int interval = now - lastFault;
+
+    lastFault = now;
+    faultTime = stats->totalTicks;
+    if (interval < PFF_GROW && resident + window > allowance)
+        coremap->Grow(this, window);
+    else if (interval > PFF_SHRINK)
+        coremap->Shrink(this);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::VirtualTime
+//  Ticks de usuario que corrió este proceso
+//----------------------------------------------------------------------
+int AddrSpace::VirtualTime() {
+    if (currentThread->space == this)
+        return cpuTicks + stats->userTicks - runSince;
+    return cpuTicks;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::DropPage
+//  Como SwapOut, para una página que no hace falta guardar (código)
+//----------------------------------------------------------------------
+void AddrSpace::DropPage(int vpn) {
+    pageTable[vpn].physicalPage = -1;
+
+#ifdef USE_TLB
+    if (asidOwner[asid] == this)
+        machine->InvalidateTLBPage(vpn, asid);
+#endif
+    
+    DEBUG('a',"----- Page %d dropped\n", vpn);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+//  Si otro espacio sigue compartiendo el marco, copiamos la página a
+//  un marco propio; si no, alcanza con volver a permitir la escritura.
+//  La entrada de la TLB se actualiza en el lugar, así la instrucción
+//  (o el kernel) puede reintentar el acceso enseguida.
+//----------------------------------------------------------------------
+bool AddrSpace::CopyOnWrite(int vpn) {
+    if (!cow[vpn])
+        return false;
+
+    TranslationEntry *entry = &pageTable[vpn];
+#ifdef USE_TLB
+    int slot = machine->LookupTLB(vpn);
+    if (slot >= 0)
+        SaveEntry(machine->tlb[slot]);
+#endif
+    int frame = coremap->CopyOnWrite(entry->physicalPage, this, entry);
+
+    DEBUG('a',"----- Page %d copied on write, frame %d -> %d\n", vpn,
+            entry->physicalPage, frame);
+    entry->physicalPage = frame;
+    entry->readOnly = false;
+    entry->dirty = true;
+    cow[vpn] = false;
+#ifdef USE_TLB
+    if (slot >= 0)      // la misma entrada, con el marco nuevo
+        machine->UpdateTLBEntry(slot, entry);
+#endif
+    return true;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::SwapIn
+//  Trae del swap las count páginas desde vpn, que están en lugares
+//  seguidos, con una sola lectura
 //----------------------------------------------------------------------
-void AddrSpace::SwapIn(int vpn, int physPage) {
-    pageTable[vpn].physicalPage = physPage;
-    swap->ReadAt(&(machine->mainMemory[physPage*PageSize]), PageSize, vpn*PageSize);
+void AddrSpace::SwapIn(int vpn, int count, int *frames) {
+    char buffer[FAULT_AROUND * PageSize];
+    char *pages = buffer;
+
+    if (count == 1)     // directo al marco
+        pages = &machine->mainMemory[frames[0] * PageSize];
+    swapFile->ReadAt(pages, count * PageSize, swapSlot[vpn] * PageSize);
+    for (int i = 0; i < count; i++) {
+        pageTable[vpn + i].physicalPage = frames[i];
+        if (count > 1)
+            memcpy(&machine->mainMemory[frames[i] * PageSize],
+                   &buffer[i * PageSize], PageSize);
+        machine->InvalidateDecodedPage(frames[i]);
+    }
     
-    DEBUG('a',"----- Page %d loaded from disk into frame %d\n", vpn, physPage);
+    DEBUG('a',"----- Pages %d-%d loaded from disk\n", vpn, vpn + count - 1);
 }
 #endif
 
@@ -341,6 +799,47 @@ TranslationEntry *AddrSpace::GetEntry(int index){
 #ifdef USE_TLB
 void AddrSpace::SaveEntry(TranslationEntry entry){
     ASSERT(CheckVPN(entry.virtualPage));
+    // el bit de uso sólo lo borra el reemplazo de páginas (CoreMap): si
+    // la TLB ya lo pasó a la tabla (ForgetUse), no hay que perderlo
+    entry.use = entry.use || pageTable[entry.virtualPage].use;
     pageTable[entry.virtualPage] = entry;
 }
+
+//----------------------------------------------------------------------
+// AddrSpace::SaveTLBEntry
+//  Guarda la entrada slot de la TLB (con sus bits de uso y
+//  modificación) en la tabla del espacio al que pertenece, que no
+//  tiene por qué ser el actual
+//----------------------------------------------------------------------
+void AddrSpace::SaveTLBEntry(int slot){
+    AddrSpace *owner = asidOwner[machine->tlb[slot].asid];
+
+    ASSERT(machine->tlb[slot].valid && owner != NULL);
+    owner->SaveEntry(machine->tlb[slot]);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::TLBSlot
+//  La entrada de la TLB que tiene la página vpn de este espacio, o -1
+//----------------------------------------------------------------------
+int AddrSpace::TLBSlot(int vpn){
+    if (asidOwner[asid] != this)
+        return -1;
+    return machine->LookupTLB(vpn, asid);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FlushTLBEntries
+//  Saca de la TLB las entradas de este espacio, guardando sus bits
+//  en la tabla de páginas
+//----------------------------------------------------------------------
+void AddrSpace::FlushTLBEntries(){
+    if (asidOwner[asid] != this)
+        return;
+    for (int i = 0; i < TLBSize; i++)
+        if (machine->tlb[i].valid && machine->tlb[i].asid == asid) {
+            SaveEntry(machine->tlb[i]);
+            machine->InvalidateTLBEntry(i);
+        }
+}
 #endif
@@ -17,18 +17,39 @@
 #include "filesys.h"
 #include "bitmap.h"
 #include "machine.h"
+#include "noff.h"
+
+struct SharedText;
 
 #define UserStackSize		1024 	// increase this as necessary!
 
 const unsigned MAX_ARG_COUNT  = 32;
 const unsigned MAX_ARG_LENGTH = 128;
 
+#define FAULT_AROUND 8      // máximo de páginas que trae un fallo
+
+#ifdef USE_TLB
+// Políticas de reemplazo de la TLB, para elegir la entrada a pisar en un
+// fallo, dentro del conjunto de la página. Se elige al arrancar (-tlbr)
+enum TLBReplacement {
+    FifoTLBReplacement,         // por turno
+    NRUTLBReplacement,          // la primera no usada recientemente
+    RandomTLBReplacement,       // cualquiera
+    ClockTLBReplacement         // segunda oportunidad
+};
+
+extern TLBReplacement TLBReplacementNamed(const char *name);
+extern const char *TLBReplacementName(TLBReplacement policy);
+#endif
 
 class AddrSpace {
   public:
     AddrSpace(OpenFile *executable, int pid);	// Create an address space,
 	                    				// initializing it with the program
 					                    // stored in the file "executable"
+    AddrSpace(AddrSpace *parent, int pid);  // Copia de parent, para Fork (con
+                                            // VM, las páginas se comparten
+                                            // hasta que alguno escriba)
     ~AddrSpace();			            // De-allocate an address space
 
     void InitRegisters();		        // Initialize user-level CPU registers,
@@ -42,21 +63,79 @@ class AddrSpace {
 #ifdef USE_TLB
     void SaveEntry(TranslationEntry entry); //guarda una entrada victima de la tlb #def
     //Chequea si una página está dentro del límite del proceso
+    static void SaveTLBEntry(int slot); // Lo mismo, en el espacio dueño de
+                                        // la entrada (por su ASID)
+    int TLBSlot(int vpn);               // Entrada de la TLB con la página
+                                        // vpn, o -1
+    void FlushTLBEntries();             // Saca sus entradas de la TLB
 #endif
 
 #ifdef VM
-    void SwapIn(int vpn, int physPage);
+    void PageIn(int vpn);               // Trae la página vpn a memoria, del
+                                        // swap o del ejecutable (o la
+                                        // comparte, si es código)
+    void SwapIn(int vpn, int count, int *frames);
     void SwapOut(int vpn);
+    void DropPage(int vpn);             // Saca la página, sin guardarla
+    bool CopyOnWrite(int vpn);          // Primera escritura en una página
+                                        // compartida por Fork: la copia.
+                                        // false si no era de ésas
 #endif
 
     TranslationEntry *pageTable;	
+#ifdef VM
+    AddrSpace **cowNext;                // por página: el siguiente espacio
+                                        // que comparte su marco (CoreMap)
+    int resident;                       // páginas propias (no de código)
+                                        // en memoria
+    int allowance;                      // cuántas puede tener (CoreMap
+                                        // la ajusta según sus fallos)
+    int faultTime;                      // tick del último fallo
+    AddrSpace *nextAdmitted;            // lista de CoreMap
+#endif
   
   private:
     int pid;
+#ifdef USE_TLB
+    int asid;                           // con el que marca sus entradas
+                                        // en la TLB
+#endif
     unsigned int numPages;		// Number of pages in the virtual 
 					            // address space
+    OpenFile *exeFile;                  // el ejecutable, abierto mientras
+                                        // exista el espacio
+    int *exeUsers;                      // espacios que lo usan (Fork)
+    NoffHeader noffH;                   // su encabezado
+    void LoadPage(int vpn, int physPage);   // Carga la página vpn desde el
+                                            // ejecutable (o en cero)
+    void LoadPages(int vpn, int count, int *frames);
+                                        // Lo mismo para count páginas
+                                        // seguidas, en los marcos frames
 #ifdef VM
-    OpenFile *swap;
+    int *swapSlot;                      // lugar de la página en el swap,
+                                        // -1 si no tiene (si no está
+                                        // modificada, la copia ahí es
+                                        // igual a la de memoria; si no
+                                        // tiene, la del ejecutable lo es)
+    bool *cow;                          // la página es de sólo lectura
+                                        // porque la comparte con un Fork
+    int NewSwapSlot(int vpn);
+    int FaultAround(int vpn, int *frames);
+                                        // Marcos para las páginas que
+                                        // siguen a vpn, a traer con ella
+    int window;                         // cuántas páginas trae un fallo:
+                                        // crece si los fallos son
+                                        // secuenciales
+    int nextFault;                      // primera página después de las
+                                        // que trajo el último fallo
+    int cpuTicks;                       // ticks de usuario que corrió,
+    int runSince;                       // hasta que lo pusieron a correr
+                                        // por última vez
+    int lastFault;                      // cuándo falló (en sus ticks)
+    int VirtualTime();
+    void CheckFaultRate();              // Ajusta allowance (PFF)
+    SharedText *text;                   // páginas de código (las primeras),
+                                        // compartidas; NULL si no hay
 #endif
 };
 
@@ -56,6 +56,10 @@
 #define SC_OK  0
 #define SC_ERROR -1
 
+// En __start (test/start.s), el "jal Exit" con $4 = 0 en el delay
+// slot: ahí vuelve la función de un Fork cuando termina
+#define EXIT_STUB 8
+
 char **SaveArgs(int address) {
     ASSERT(address != 0);
 
@@ -63,7 +67,8 @@ char **SaveArgs(int address) {
     int val;
     unsigned i = 0;
     do {
-        machine->ReadMem(address + i * 4, 4, &val);
+        if (!machine->ReadMem(address + i * 4, 4, &val))
+            ASSERT(machine->ReadMem(address + i * 4, 4, &val));
         i++;
     } while (i < MAX_ARG_COUNT && val != 0);
     if (i == MAX_ARG_COUNT && val != 0)
@@ -79,7 +84,8 @@ char **SaveArgs(int address) {
     // Para cada puntero leemos la cadena correspondiente.
     for (unsigned j = 0; j < i - 1; j++) {
         ret[j] = new char [MAX_ARG_LENGTH];
-        machine->ReadMem(address + j * 4, 4, &val);
+        if (!machine->ReadMem(address + j * 4, 4, &val))
+            ASSERT(machine->ReadMem(address + j * 4, 4, &val));
         ReadStringFromUser(val, ret[j], MAX_ARG_LENGTH);
     }
     // Escribimos el último NULL.
@@ -109,6 +115,40 @@ void startProc(void *args) {
     currentThread->space->WriteArgs((char **) args);
     machine->Run();
 }
+
+
+// Inicia el hilo de un Fork, con los registros que
+// le preparó el padre
+void startFork(void *regs) {
+    for (int i = 0; i < NumTotalRegs; i++)
+        machine->WriteRegister(i, ((int *) regs)[i]);
+    delete [] (int *) regs;
+    currentThread->space->RestoreState();
+    machine->Run();
+}
+
+
+// Para Read y Write: mueven los bytes directamente entre
+// los marcos del proceso y el archivo o la consola
+int readFile(void *file, char *buf, unsigned count) {
+    return ((OpenFile *) file)->Read(buf, count);
+}
+
+int writeFile(void *file, char *buf, unsigned count) {
+    return ((OpenFile *) file)->Write(buf, count);
+}
+
+int readConsole(void *arg, char *buf, unsigned count) {
+    for (unsigned i = 0; i < count; i++)
+        buf[i] = synchedConsole->SynchGetChar();
+    return count;
+}
+
+int writeConsole(void *arg, char *buf, unsigned count) {
+    for (unsigned i = 0; i < count; i++)
+        synchedConsole->SynchPutChar(buf[i]);
+    return count;
+}
  
 
 // Maneja una excepcion de tipo Syscall
@@ -139,8 +179,7 @@ void handleSyscall() {
              */
             int eCode = machine->ReadRegister(4);
             DEBUG('a', "***** Thread finished with status code: %d\n", eCode);
-            currentThread->exitCode = eCode;
-            currentThread->Finish();
+            currentThread->Finish(eCode);
             break;
         }
             
@@ -166,15 +205,17 @@ void handleSyscall() {
             if (bin) {
                 char **args = SaveArgs(args_addr);
                 
-                Thread *binThread = new Thread(path, prio);
-
-                binThread->Fork(startProc, args);
+                Thread *binThread = new Thread(path, prio, true);
                 SpaceId pid = newThread(binThread);
+                binThread->setParent(currentThread);    // el que hace Join
  
+                ASSERT(pid != -1);
+
+                // El espacio tiene que estar antes del Fork: si el hijo
+                // corre primero, startProc lo usa.
                 AddrSpace *binSpace = new AddrSpace(bin, pid);
                 binThread->space = binSpace;
-                
-                ASSERT(pid != -1);
+                binThread->Fork(startProc, args);
 
                 machine->WriteRegister(2, pid);
                 DEBUG('a', "***** Executing binary %s with pid: %d\n", path, pid);
@@ -201,8 +242,8 @@ void handleSyscall() {
             
             if (thread) {
                 DEBUG('a', "***** Joining pid: %d\n", (int) pid);
+                removeThread(pid);  // nadie mas puede hacerle Join
                 machine->WriteRegister(2, thread->Join()); //hago return con lo que devuelve t.
-                removeThread(pid);
             } else {
                 DEBUG('a', "***** Invalid pid to join: %d\n", (int) pid);
                 machine->WriteRegister(2, SC_ERROR);
@@ -277,14 +318,14 @@ void handleSyscall() {
             int size = machine->ReadRegister(5);
             OpenFileId fd = (OpenFileId) machine->ReadRegister(6);     
             
-            char data[size];
-            
+            if (size < 0) {
+                machine->WriteRegister(2, SC_ERROR);
+                break;
+            }
+
             // Leemos desde consola
             if (fd == ConsoleInput) {
-                
-                for(int i=0; i<size; i++) data[i] = synchedConsole->SynchGetChar();
-				
-				WriteBufferToUser(data, dest, size);
+                TransferToUser(dest, size, readConsole, NULL, true);
 				machine->WriteRegister(2, size);
                 break;
             }
@@ -292,9 +333,8 @@ void handleSyscall() {
             // Sino, leemos desde un archivo
             OpenFile *file = currentThread->getOpenFile(fd);
             if (file) { 
-                int read = file->Read(data, size);
+                int read = TransferToUser(dest, size, readFile, file);
                 DEBUG('a', "+++++ %d bytes read from fd %d\n", read, fd);
-                WriteBufferToUser(data, dest, read);
                 machine->WriteRegister(2, read);
             } else {
                 DEBUG('a', "+++++ Trying to read from invalid fd: %d\n", fd);
@@ -318,12 +358,14 @@ void handleSyscall() {
             int size = machine->ReadRegister(5);     
             int source = machine->ReadRegister(4);     
     
-            char data[size];
-            ReadBufferFromUser(source, data, size);
-		    
+            if (size < 0) {
+                machine->WriteRegister(2, SC_ERROR);
+                break;
+            }
+
             // Escribimos a la consola
             if (fd == ConsoleOutput) {
-                for(int i=0; i<size; i++) synchedConsole->SynchPutChar(data[i]);
+                TransferFromUser(source, size, writeConsole, NULL, true);
 				machine->WriteRegister(2, size);
                 break;
             }
@@ -331,7 +373,7 @@ void handleSyscall() {
             // Sino, escribimos a un archivo
             OpenFile *file = currentThread->getOpenFile(fd);
             if (file) { 
-                int written = file->Write(data, size);
+                int written = TransferFromUser(source, size, writeFile, file);
                 DEBUG('a', "+++++ %d bytes written to fd %d\n", written, fd);
                 machine->WriteRegister(2, written);
             } else {
@@ -341,6 +383,44 @@ void handleSyscall() {
             break;
         }
             
+        case SC_Fork:
+        {
+            /*
+             *  void Fork(void (*func)())
+             *
+             *  Crea un proceso con una copia del espacio de
+             *  direcciones (compartida hasta que alguno escriba),
+             *  que corre func y termina cuando func vuelve.
+             *  Al padre le devuelve el pid del hijo, o SC_ERROR.
+             */
+            int func = machine->ReadRegister(4);
+
+            Thread *child = new Thread("fork", currentThread->getPriority(),
+                                       true);
+            SpaceId pid = newThread(child);
+            if (pid == -1) {
+                delete child;
+                machine->WriteRegister(2, SC_ERROR);
+                break;
+            }
+            child->setParent(currentThread);
+            child->space = new AddrSpace(currentThread->space, pid);
+
+            // mismos registros (y pila) que el padre, pero en func
+            int *regs = new int[NumTotalRegs];
+            for (int i = 0; i < NumTotalRegs; i++)
+                regs[i] = machine->ReadRegister(i);
+            regs[2] = 0;
+            regs[PCReg] = func;
+            regs[NextPCReg] = func + 4;
+            regs[RetAddrReg] = EXIT_STUB;
+            child->Fork(startFork, regs);
+
+            DEBUG('a', "***** Forked pid %d at 0x%x\n", pid, func);
+            machine->WriteRegister(2, pid);
+            break;
+        }
+
         case SC_Close:
         {
             /*
@@ -374,7 +454,88 @@ void handleSyscall() {
 }
 
 #ifdef USE_TLB
-static int entry = 0;  //Índice de la proxima página a usar
+static const char *tlbPolicyNames[] = { "fifo", "nru", "random", "clock" };
+
+//----------------------------------------------------------------------
+// TLBReplacementNamed
+//  La política de nombre name (opción -tlbr)
+//----------------------------------------------------------------------
+TLBReplacement TLBReplacementNamed(const char *name) {
+    for (int i = 0; i <= ClockTLBReplacement; i++)
+        if (!strcmp(name, tlbPolicyNames[i]))
+            return (TLBReplacement) i;
+    ASSERT(false); // no existe
+    return FifoTLBReplacement;
+}
+
+//----------------------------------------------------------------------
+// TLBReplacementName
+//----------------------------------------------------------------------
+const char *TLBReplacementName(TLBReplacement policy) {
+    return tlbPolicyNames[policy];
+}
+
+static int nextVictim[TLBSize];  //Índice (dentro de cada conjunto de la
+                                 //TLB) de la proxima entrada a usar, o
+                                 //la aguja del reloj
+
+//----------------------------------------------------------------------
+// ForgetUse
+//  Borra el bit de uso de la entrada slot de la TLB. Antes lo pasa a
+//  la tabla de páginas de su dueño, para que el reemplazo de páginas
+//  no pierda la referencia.
+//----------------------------------------------------------------------
+static void ForgetUse(int slot) {
+    AddrSpace::SaveTLBEntry(slot);
+    machine->tlb[slot].use = false;
+}
+
+//----------------------------------------------------------------------
+// TLBVictim
+//  La entrada a pisar, en el conjunto de la TLB que empieza en start.
+//  Salvo FIFO (que reproduce el reemplazo por turno de siempre), las
+//  políticas usan primero una entrada inválida, si hay.
+//----------------------------------------------------------------------
+static int TLBVictim(int start) {
+    TranslationEntry *tlb = machine->tlb;
+    int ways = machine->TLBWays();
+    int set = start / ways;
+    int slot;
+
+    if (tlbReplacement != FifoTLBReplacement)
+        for (slot = start; slot < start + ways; slot++)
+            if (!tlb[slot].valid)
+                return slot;
+
+    switch (tlbReplacement) {
+        case NRUTLBReplacement:
+            for (slot = start; slot < start + ways; slot++)
+                if (!tlb[slot].use)
+                    return slot;
+            // todas se usaron: empieza otro período
+            for (slot = start; slot < start + ways; slot++)
+                ForgetUse(slot);
+            return start;
+
+        case RandomTLBReplacement:
+            return start + Random() % ways;
+
+        case ClockTLBReplacement:
+            // la aguja le saca el bit de uso a las que lo tienen
+            for (;;) {
+                slot = start + nextVictim[set];
+                nextVictim[set] = (nextVictim[set] + 1) % ways;
+                if (!tlb[slot].use)
+                    return slot;
+                ForgetUse(slot);
+            }
+
+        default:
+            slot = start + nextVictim[set];
+            nextVictim[set] = (nextVictim[set] + 1) % ways;
+            return slot;
+    }
+}
 #endif
 
 void handlePageFault(){
@@ -389,20 +550,18 @@ void handlePageFault(){
 #ifdef VM
     TranslationEntry *faultPage = currentThread->space->GetEntry(vpn);
     if (faultPage->physicalPage == -1) {
-        DEBUG('a',"----- Loading page %d from swap file\n", vpn);
-        int frame = coremap->Find(currentThread->space, faultPage);
-        faultPage->physicalPage = frame;
-        currentThread->space->SwapIn(vpn, faultPage->physicalPage); 
+        DEBUG('a',"----- Loading page %d\n", vpn);
+        currentThread->space->PageIn(vpn); 
     }
 #endif
 
 #ifdef USE_TLB    
-    if(machine -> tlb[entry].valid)
-        currentThread->space->SaveEntry(machine->tlb[entry]);
-    machine->tlb[entry] = *(currentThread->space->GetEntry(vpn));
+    // La página sólo puede ir en el conjunto de la TLB que le corresponde
+    int entry = TLBVictim(machine->TLBSetStart(vpn));
+    if(machine -> tlb[entry].valid)     // puede ser de otro espacio
+        AddrSpace::SaveTLBEntry(entry);
+    machine->LoadTLBEntry(entry, currentThread->space->GetEntry(vpn));
     DEBUG('a', "----- TLB swap happened, victim page: %d\n", entry); 
-    //Ver bien como elegirlas
-    entry = (entry+1) % TLBSize;
 #endif
 }
 
@@ -418,7 +577,13 @@ void ExceptionHandler(ExceptionType which) {
             handlePageFault();
             #endif
             break;
-        case ReadOnlyException: //?
+        case ReadOnlyException:
+#ifdef VM
+            // si la comparte con un Fork, la copiamos
+            if (currentThread->space->CopyOnWrite(
+                    machine->ReadRegister(BadVAddrReg) / PageSize))
+                break;
+#endif
             DEBUG('a', "----- Write attempt on read-only page\n");
             currentThread->Finish();
             break;
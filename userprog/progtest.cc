@@ -30,11 +30,9 @@ StartProcess(const char *filename)
 	printf("Unable to open file %s\n", filename);
 	return;
     }
-    space = new AddrSpace(executable, 1);    
+    space = new AddrSpace(executable, 1);	// keeps the file open    
     currentThread->space = space;
 
-    delete executable;			// close file
-
     space->InitRegisters();		// set the initial register values
     space->RestoreState();		// load page table register
 
@@ -1,28 +1,75 @@
 #include "readwrite.h"
 
+#include <string.h>
+
+// Cuántas páginas del buffer de un Read/Write se fijan en memoria a la vez
+#define MAX_PINNED_PAGES 8
+
+//----------------------------------------------------------
+//  UserBytes
+//  Traduce usrAddr y devuelve un puntero a ese byte en la
+//  memoria principal. Si la pagina no esta en la TLB (o esta
+//  en swap) se levanta la excepcion una sola vez y se vuelve
+//  a traducir. Desde ahi hasta el fin de la pagina los bytes
+//  son contiguos, asi que se pueden copiar de una vez.
+//----------------------------------------------------------
+static char *UserBytes(int usrAddr, bool writing){
+    int physAddr;
+    ExceptionType exception;
+
+    exception = machine->Translate(usrAddr, &physAddr, 1, writing);
+    if (exception != NoException) {
+        machine->RaiseException(exception, usrAddr);
+        exception = machine->Translate(usrAddr, &physAddr, 1, writing);
+        ASSERT(exception == NoException);
+    }
+    if (writing)    // la pagina puede tener codigo ya decodificado
+        machine->InvalidateDecodedPage(physAddr / PageSize);
+    return &machine->mainMemory[physAddr];
+}
+
+//----------------------------------------------------------
+//  BytesInPage
+//  Cuantos de los byteCount bytes a partir de usrAddr caen
+//  en la misma pagina que usrAddr
+//----------------------------------------------------------
+static unsigned BytesInPage(int usrAddr, unsigned byteCount){
+    unsigned left = PageSize - (unsigned) usrAddr % PageSize;
+
+    return left < byteCount ? left : byteCount;
+}
+
 //----------------------------------------------------------
 //  ReadStringFromUser
 //----------------------------------------------------------
 void ReadStringFromUser(int usrAddr, char *outStr, unsigned byteCount) {
-    unsigned i = 0;
-    int c;
-    
-    do {
-        if (!machine->ReadMem(usrAddr+i, 1, &c))
-          ASSERT(machine->ReadMem(usrAddr+i,1,&c));
-        outStr[i++] = (char) c;
-    } while(c !='\0' && i<byteCount);
+    while (byteCount > 0) {
+        unsigned n = BytesInPage(usrAddr, byteCount);
+        char *src = UserBytes(usrAddr, false);
+        char *end = (char *) memchr(src, '\0', n);
+
+        if (end != NULL) {
+            memcpy(outStr, src, end - src + 1);
+            return;
+        }
+        memcpy(outStr, src, n);
+        usrAddr += n;
+        outStr += n;
+        byteCount -= n;
+    }
 }
 
 //----------------------------------------------------------
 //  ReadBufferFromUser
 //----------------------------------------------------------
 void ReadBufferFromUser(int usrAddr, char *outBuff, unsigned byteCount){
-    int c;
-    for(unsigned i=0; i<byteCount; i++){
-       if (!machine->ReadMem(usrAddr+i, 1, &c))
-          ASSERT(machine->ReadMem(usrAddr+i,1,&c));
-       outBuff[i] = (char) c;
+    while (byteCount > 0) {
+        unsigned n = BytesInPage(usrAddr, byteCount);
+
+        memcpy(outBuff, UserBytes(usrAddr, false), n);
+        usrAddr += n;
+        outBuff += n;
+        byteCount -= n;
     }
 }
 
@@ -30,15 +77,7 @@ void ReadBufferFromUser(int usrAddr, char *outBuff, unsigned byteCount){
 //  WriteStringToUser
 //----------------------------------------------------------
 void WriteStringToUser(char *str, int usrAddr){
-    unsigned i = 0;
-    char c;
-    
-    do {
-        c = str[i];
-        if (!machine->WriteMem(usrAddr+i, 1, c))
-          ASSERT(machine->WriteMem(usrAddr+i, 1, c));
-        i++;
-    } while(c !='\0');
+    WriteBufferToUser(str, usrAddr, strlen(str) + 1);
 }
 
 
@@ -46,11 +85,78 @@ void WriteStringToUser(char *str, int usrAddr){
 //  WriteBufferToUser
 //----------------------------------------------------------
 void WriteBufferToUser(char *str, int usrAddr, unsigned byteCount){
-    char c;
-    for(unsigned i=0; i<byteCount; i++){
-        c = str[i];
-        if (!machine->WriteMem(usrAddr+i, 1, c))
-          ASSERT(machine->WriteMem(usrAddr+i, 1, c));
+    while (byteCount > 0) {
+        unsigned n = BytesInPage(usrAddr, byteCount);
+
+        memcpy(UserBytes(usrAddr, true), str, n);
+        usrAddr += n;
+        str += n;
+        byteCount -= n;
     }
 }
 
+//----------------------------------------------------------
+//  TransferUser
+//  Recorre el buffer de usuario de a tramos contiguos de
+//  memoria principal, y llama a transfer con cada uno. Las
+//  páginas de la ventana actual quedan fijadas mientras
+//  tanto, asi transfer puede bloquearse (ej: el disco) sin
+//  que otro proceso las mande a swap. Si transfer puede
+//  bloquearse sin límite (blocking), la ventana es de una
+//  sola página: si no, unos pocos lectores de la consola
+//  dejarían sin marcos para desalojar. Termina cuando
+//  transfer devuelve menos bytes que los pedidos.
+//----------------------------------------------------------
+static int TransferUser(int usrAddr, unsigned byteCount, bool writing,
+                        UserTransfer transfer, void *arg, bool blocking){
+    char *spans[MAX_PINNED_PAGES];
+    unsigned sizes[MAX_PINNED_PAGES];
+    int window = blocking ? 1 : MAX_PINNED_PAGES;
+    int total = 0;
+    bool done = false;
+
+    while (byteCount > 0 && !done) {
+        int count = 0;
+
+        // fijamos las paginas de la ventana, trayendolas si hace falta
+        for (; count < window && byteCount > 0; count++) {
+            sizes[count] = BytesInPage(usrAddr, byteCount);
+            spans[count] = UserBytes(usrAddr, writing);
+#ifdef VM
+            coremap->Pin((spans[count] - machine->mainMemory) / PageSize);
+#endif
+            usrAddr += sizes[count];
+            byteCount -= sizes[count];
+        }
+
+        for (int i = 0; i < count && !done; i++) {
+            int n = transfer(arg, spans[i], sizes[i]);
+
+            if (n > 0)
+                total += n;
+            done = n < (int) sizes[i];
+        }
+
+#ifdef VM
+        for (int i = 0; i < count; i++)
+            coremap->Unpin((spans[i] - machine->mainMemory) / PageSize);
+#endif
+    }
+    return total;
+}
+
+//----------------------------------------------------------
+//  TransferToUser
+//----------------------------------------------------------
+int TransferToUser(int usrAddr, unsigned byteCount, UserTransfer fill,
+                   void *arg, bool blocking){
+    return TransferUser(usrAddr, byteCount, true, fill, arg, blocking);
+}
+
+//----------------------------------------------------------
+//  TransferFromUser
+//----------------------------------------------------------
+int TransferFromUser(int usrAddr, unsigned byteCount, UserTransfer drain,
+                     void *arg, bool blocking){
+    return TransferUser(usrAddr, byteCount, false, drain, arg, blocking);
+}
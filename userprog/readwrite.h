@@ -28,4 +28,26 @@ void WriteStringToUser(char *str, int usrAddr);
 */
 void WriteBufferToUser(char *str, int usrAddr, unsigned byteCount);
 
+/*
+ * Mueve count bytes entre buf y un archivo o la consola. Devuelve
+ * cuántos movió; si son menos que count, no se pide más.
+*/
+typedef int (*UserTransfer)(void *arg, char *buf, unsigned count);
+
+/*
+ * Llena byteCount bytes del buffer de usuario en usrAddr llamando a
+ * fill directamente sobre los marcos de memoria (sin copia intermedia).
+ * Devuelve cuántos bytes se llenaron. Si fill puede bloquearse sin
+ * límite (la consola), blocking debe ser true: así sólo queda fijada
+ * la página que se está llenando.
+*/
+int TransferToUser(int usrAddr, unsigned byteCount, UserTransfer fill,
+                   void *arg, bool blocking = false);
+
+/*
+ * Igual, pero pasándole a drain los bytes del buffer de usuario
+*/
+int TransferFromUser(int usrAddr, unsigned byteCount, UserTransfer drain,
+                     void *arg, bool blocking = false);
+
 #endif //READWRITE_H
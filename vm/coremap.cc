@@ -1,127 +1,1047 @@
 #include "coremap.h"
+#include "system.h"
+
+static const char *policyNames[] = {
+    "fifo", "clock", "eclock", "wsclock", "aging", "2q"
+};
+
+//------------------------------------------
+//  ReplacementPolicy ReplacementNamed(const char *name)
+//  La política de nombre "name" (opción -vm)
+//------------------------------------------
+ReplacementPolicy ReplacementNamed(const char *name) {
+    for (int i = 0; i <= TwoQReplacement; i++)
+        if (!strcmp(name, policyNames[i]))
+            return (ReplacementPolicy) i;
+    ASSERT(false); // no existe
+    return FifoReplacement;
+}
+
+//------------------------------------------
+//  const char *ReplacementName(ReplacementPolicy policy)
+//------------------------------------------
+const char *ReplacementName(ReplacementPolicy policy) {
+    return policyNames[policy];
+}
 
 //------------------------------------------
-//  CoreMap::CoreMap(int nitems)
+//  PagerHelper
+//  Dummy function because C++ can't indirectly
+//  invoke member functions
 //------------------------------------------
-CoreMap::CoreMap() {
+static void PagerHelper(void *arg) {
+    ((CoreMap *) arg)->Pageout();
+}
+
+//------------------------------------------
+//  CoreMap::CoreMap(ReplacementPolicy replacement)
+//------------------------------------------
+CoreMap::CoreMap(ReplacementPolicy replacement) {
 	
-	physframes = new List<int>;
+	policy = replacement;
+	texts = NULL;
 	
     for (int i=0; i<NumPhysPages; i++){
         pages[i].space = NULL;
         pages[i].entry = NULL;
+        pages[i].pinned = 0;
+        pages[i].text = NULL;
+        pages[i].refs = 0;
+        pages[i].lastUse = 0;
+        pages[i].vpn = -1;
+        pages[i].age = 0;
+        pages[i].queue = 0;
+        pages[i].older = pages[i].newer = -1;
+        freeFrames[i] = NumPhysPages - 1 - i;   // el 0 sale primero
 	}
-    usedPages = 0;
+    numFree = NumPhysPages;
+    hand = 0;
+    for (int q = 0; q < NUM_QUEUES; q++) {
+        oldest[q] = newest[q] = -1;
+        queueLength[q] = 0;
+    }
+    for (int i = 0; i < NUM_GHOSTS; i++)
+        ghosts[i].space = NULL;
+    nextGhost = 0;
+    stats->replacement = ReplacementName(policy);
+
+    committed = numAdmitted = 0;
+    admitted = NULL;
+    suspended = NULL;
+    trimHand = 0;
+
+    // el pager espera a que falten marcos
+    pagerWake = new Semaphore("pager", 0);
+    pagerAwake = false;
+    Thread *t = new Thread("pager", MAX_PRIORITY - 1);
+
+    t->Fork(PagerHelper, this);
 }
 
 //------------------------------------------
 //  CoreMap::~CoreMap()
 //------------------------------------------
 CoreMap::~CoreMap() {
-	delete physframes;
+    delete pagerWake;
 }
 
 
 //------------------------------------------
 //  void CoreMap::Clear(int which)
+//  El marco vuelve a la pila de libres
 //------------------------------------------
 void CoreMap::Clear(int frame) {
-    ASSERT(frame > 0 && frame < NumPhysPages);
+    ASSERT(frame >= 0 && frame < NumPhysPages);
 	
-    if (pages[frame].space) usedPages--;
+    if (pages[frame].space) {
+        Dequeue(frame);
+        freeFrames[numFree++] = frame;
+    }
     pages[frame].space = NULL;
     pages[frame].entry = NULL;
-    physframes->RemItem(frame);
-    
+    pages[frame].pinned = 0;
+    pages[frame].text = NULL;
+    pages[frame].refs = 0;
+}
+
+//------------------------------------------
+//  void CoreMap::Pin(int frame)
+//  Mientras el marco esté fijado no se manda a
+//  swap (ej: un Read está escribiendo en él).
+//------------------------------------------
+void CoreMap::Pin(int frame) {
+    ASSERT(frame >= 0 && frame < NumPhysPages);
+    pages[frame].pinned++;
+}
+
+//------------------------------------------
+//  void CoreMap::Unpin(int frame)
+//------------------------------------------
+void CoreMap::Unpin(int frame) {
+    ASSERT(frame >= 0 && frame < NumPhysPages);
+    ASSERT(pages[frame].pinned > 0);
+    pages[frame].pinned--;
 }
 
 //------------------------------------------
 //  int CoreMap::Find(AddrSpace *space, int page)
+//  Si hay marcos libres se usa el de arriba de la
+//  pila; si no, el más viejo de los que liberó el
+//  pager; y si tampoco (el pager no llegó), la
+//  política elige una víctima y se la desaloja acá.
+//
+//  Al pager se lo despierta antes de tocar nada:
+//  V puede ceder el procesador, y el pager podría
+//  llevarse el marco a medio asignar.
 //------------------------------------------
 int CoreMap::Find(AddrSpace *space, TranslationEntry *entry) {
-    
-    // no hay lugar en memoria, mandamos una víctima a 
-    // swap y usamos su lugar
-    if (usedPages == NumPhysPages) {
-        #ifdef CLOCK
-        int victim = clock_find();
-        #else
-        int victim = physframes->Remove();
-        #endif
-        int victimVPN = pages[victim].entry->virtualPage;
-        pages[victim].space->SwapOut(victimVPN);
-        pages[victim].space = space;
-        pages[victim].entry = entry;
-        physframes->Append(victim);
-        //pages[victim].vpn = vpn;
-        
-        return victim;
-    }
-    
-    // hay lugar en memoria, buscamos el primero disponible
-    for (int i=0; i<NumPhysPages; i++){
-        if (!pages[i].space) {
-            pages[i].space = space;
-            //pages[i].vpn = vpn;
-            pages[i].entry = entry;
-			physframes->Append(i);
-			
-            usedPages++;
-            return i;
-        }
+    int frame;
+
+    int queue = 0;
+
+    if (Available() <= PAGER_LOW && !pagerAwake) {
+        pagerAwake = true;
+        pagerWake->V();
+    }
+    frame = Take();
+    if (frame == -1) {
+        // no hay lugar en memoria, mandamos una víctima a 
+        // swap y usamos su lugar
+        frame = Victim();
+        ASSERT(frame != -1);    // todos los marcos fijados
+        Evict(frame);
+    }
+    // 2Q: si se la desalojó hace poco, se usa seguido (va a Am)
+    if (policy == TwoQReplacement && Remembered(space, entry->virtualPage))
+        queue = 1;
+    Assign(frame, space, entry, queue);
+    machine->InvalidateDecodedPage(frame);
+    return frame;
+}
+
+//------------------------------------------
+//  int CoreMap::Take()
+//  El marco de arriba de la pila de libres o, si
+//  no hay, el más viejo de los que liberó el
+//  pager; -1 si tampoco
+//------------------------------------------
+int CoreMap::Take() {
+    int frame = -1;
+
+    if (numFree > 0)
+        frame = freeFrames[--numFree];
+    else if (queueLength[POOL_QUEUE] > 0) {
+        frame = oldest[POOL_QUEUE];
+        Dequeue(frame);
+        pages[frame].text = NULL;
     }
-    
-    ASSERT(false); //nunca se alcanza
+    return frame;
+}
+
+//------------------------------------------
+//  int CoreMap::FindFree(AddrSpace *space,
+//                        TranslationEntry *entry)
+//  Un marco disponible para una página que se lee
+//  por adelantado, sin desalojar a nadie ni bajar
+//  de la reserva del pager. La página no se usó todavía:
+//  es de las primeras candidatas a víctima.
+//------------------------------------------
+int CoreMap::FindFree(AddrSpace *space, TranslationEntry *entry) {
+    if (Available() <= PAGER_LOW)
+        return -1;
+
+    int frame = Take();
+
+    Assign(frame, space, entry, 0);
+    pages[frame].age = 0;
+    machine->InvalidateDecodedPage(frame);
+    return frame;
+}
+
+//------------------------------------------
+//  int CoreMap::Reclaim(AddrSpace *space, SharedText *text,
+//                       TranslationEntry *entry)
+//  Si la página "entry" de space (o del código
+//  compartido text, si no es NULL) sigue en un marco
+//  que liberó el pager, se lo devuelve sin leer
+//  nada; si no, -1
+//------------------------------------------
+int CoreMap::Reclaim(AddrSpace *space, SharedText *text,
+                     TranslationEntry *entry) {
+    for (int frame = newest[POOL_QUEUE]; frame != -1;
+         frame = pages[frame].older)
+        if (Holds(frame, space, text)
+            && pages[frame].vpn == entry->virtualPage) {
+            Dequeue(frame);
+            // se la desalojó hace poco: para 2Q, se usa seguido
+            Assign(frame, space, entry,
+                   policy == TwoQReplacement ? 1 : 0);
+            stats->numPageReclaims++;
+            return frame;
+        }
     return -1;
 }
 
-#ifdef CLOCK
-//Search for clean 
-int CoreMap::clock_find(bool use, bool dirty){
-	//Al cases can be reduced to (0,0) and (0,1) because clock resets
-	//used bits
-	
-	ASSERT(!physframes->IsEmpty());
-	int current = physframes->Remove();
-	int init = current;
-	
-	do{
-		TranslationEntry *centry = pages[current].entry;
-		//Search for (0,0)
-		if(!use && !dirty)
-			if (!centry->use && !centry->dirty) return current;
-			
-		//Search for (0,1) 
-		if(!use && dirty)
-			if(!centry->use && centry->dirty) return current;
-
-		if(centry->use) centry->use = false;
-		physframes->Append(current);
-		current = physframes->Remove();
-	} while (current != init);
-	
-	physframes->Prepend(current);
-	
-	return -1; //if no page was found
-}
-
-int CoreMap::clock_find(){
-	int victim;
-	//(0,0)
-	victim = clock_find(false, false);
-	if (victim != -1) return victim;
-	//(0,1)
-	victim = clock_find(false, true);
-	if (victim != -1) return victim;
-	//(1,0)
-	victim = clock_find(false, false);
-	if (victim != -1) return victim;
-	//(1,1)
-	victim = clock_find(false, true);
-	if (victim != -1) return victim;
-	
-	ASSERT(false);
-	return -1;
+//------------------------------------------
+//  void CoreMap::Forget(AddrSpace *space,
+//                       SharedText *text)
+//  Se destruye space (o el código compartido text):
+//  sus páginas que quedaban en marcos liberados ya
+//  no sirven
+//------------------------------------------
+void CoreMap::Forget(AddrSpace *space, SharedText *text) {
+    int frame = oldest[POOL_QUEUE];
+
+    while (frame != -1) {
+        int newer = pages[frame].newer;
+
+        if (Holds(frame, space, text)) {
+            Dequeue(frame);
+            pages[frame].space = NULL;
+            pages[frame].text = NULL;
+            freeFrames[numFree++] = frame;
+        }
+        frame = newer;
+    }
+}
+
+//------------------------------------------
+//  bool CoreMap::Holds(int frame, AddrSpace *space,
+//                      SharedText *text)
+//  Si el marco liberado tiene una página de text,
+//  o si text es NULL, una propia de space
+//------------------------------------------
+bool CoreMap::Holds(int frame, AddrSpace *space, SharedText *text) {
+    if (text != NULL)
+        return pages[frame].text == text;
+    return pages[frame].text == NULL && pages[frame].space == space;
+}
+
+//------------------------------------------
+//  void CoreMap::Assign(int frame, AddrSpace *space,
+//                       TranslationEntry *entry, int queue)
+//------------------------------------------
+void CoreMap::Assign(int frame, AddrSpace *space, TranslationEntry *entry,
+                     int queue) {
+    pages[frame].space = space;
+    pages[frame].entry = entry;
+    pages[frame].refs = 1;
+    pages[frame].lastUse = stats->totalTicks;
+    pages[frame].age = 0x80;    // recién usado
+    Enqueue(frame, queue);
+}
+
+//------------------------------------------
+//  int CoreMap::Victim()
+//  El marco que elige la política, -1 si están
+//  todos libres o fijados
+//------------------------------------------
+int CoreMap::Victim() {
+    switch (policy) {
+      case FifoReplacement:          return fifo_find();
+      case ClockReplacement:         return clock_find();
+      case EnhancedClockReplacement: return eclock_find();
+      case WSClockReplacement:       return wsclock_find();
+      case AgingReplacement:         return aging_find();
+      default:                       return twoq_find();
+    }
+}
+
+//------------------------------------------
+//  void CoreMap::Evict(int frame)
+//  Saca del marco a la página que lo ocupa (a
+//  todos los que lo comparten); el marco queda
+//  a nombre de ella
+//------------------------------------------
+void CoreMap::Evict(int frame) {
+    int victimVPN = pages[frame].entry->virtualPage;
+
+    stats->numEvictions++;
+    Dequeue(frame);
+    // el código compartido no se modifica: se vuelve a
+    // cargar del ejecutable
+    if (pages[frame].text)
+        DropText(frame);
+    else {
+        // cada uno de los que lo comparten (Fork) se guarda su copia
+        AddrSpace *sharer = pages[frame].space;
+        while (sharer) {
+            AddrSpace *next = sharer->cowNext[victimVPN];
+            sharer->cowNext[victimVPN] = NULL;
+            sharer->SwapOut(victimVPN);
+            sharer = next;
+        }
+    }
+}
+
+//------------------------------------------
+//  void CoreMap::Pageout()
+//  El pager: cuando quedan PAGER_LOW marcos
+//  disponibles o menos, desaloja víctimas
+//  (escribiendo las modificadas) hasta que haya
+//  PAGER_HIGH. Así la mayoría de los fallos de
+//  página sólo tienen que leer la página.
+//
+//  Los marcos liberados pueden quedar con su
+//  página (Release): si se la vuelve a pedir antes
+//  de que se use el marco para otra, se recupera
+//  sin leerla (Reclaim).
+//------------------------------------------
+void CoreMap::Pageout() {
+    for (;;) {
+        pagerWake->P();
+        while (Available() < PAGER_HIGH) {
+            int frame = Victim();
+
+            if (frame == -1)
+                break;          // los demás están fijados
+            Release(frame);
+            stats->numPagerEvictions++;
+        }
+        pagerAwake = false;
+    }
+}
+
+//------------------------------------------
+//  void CoreMap::Release(int frame)
+//  Desaloja la página del marco y lo deja
+//  disponible. Si la página era de un solo
+//  proceso, o código compartido, el marco queda
+//  con ella en la cola POOL_QUEUE.
+//------------------------------------------
+void CoreMap::Release(int frame) {
+    SharedText *text = pages[frame].text;
+    bool keep = text != NULL || pages[frame].refs == 1;
+
+    pages[frame].vpn = pages[frame].entry->virtualPage;
+    Evict(frame);
+    pages[frame].refs = 0;
+    pages[frame].entry = NULL;
+    if (keep) {
+        pages[frame].text = text;
+        if (text != NULL)
+            pages[frame].space = NULL;  // es de todos
+        Enqueue(frame, POOL_QUEUE);
+    } else {
+        pages[frame].space = NULL;
+        freeFrames[numFree++] = frame;
+    }
+}
+
+//------------------------------------------
+//  void CoreMap::Admit(AddrSpace *space)
+//  Un proceso nuevo arranca admitido, con la
+//  reserva mínima: si no entra, se lo suspende
+//  la primera vez que pida más (Grow)
+//------------------------------------------
+void CoreMap::Admit(AddrSpace *space) {
+    space->allowance = PFF_MIN_FRAMES;
+    committed += space->allowance;
+    numAdmitted++;
+    space->nextAdmitted = admitted;
+    admitted = space;
+}
+
+//------------------------------------------
+//  void CoreMap::Leave(AddrSpace *space)
+//------------------------------------------
+void CoreMap::Leave(AddrSpace *space) {
+    Unlink(space);
+    Readmit(false);
+}
+
+//------------------------------------------
+//  void CoreMap::Unlink(AddrSpace *space)
+//  space deja de estar admitido
+//------------------------------------------
+void CoreMap::Unlink(AddrSpace *space) {
+    AddrSpace **link = &admitted;
+
+    while (*link != space)
+        link = &(*link)->nextAdmitted;
+    *link = space->nextAdmitted;
+    committed -= space->allowance;
+    numAdmitted--;
+}
+
+//------------------------------------------
+//  int CoreMap::Squeeze(AddrSpace *space)
+//  A los admitidos (salvo space) que no fallan
+//  hace PFF_IDLE ticks les baja la reserva al
+//  mínimo. Sus páginas quedan, hasta que el
+//  reemplazo las elija. Devuelve cuántos marcos
+//  se liberaron.
+//------------------------------------------
+int CoreMap::Squeeze(AddrSpace *space) {
+    int freed = 0;
+
+    for (AddrSpace *s = admitted; s != NULL; s = s->nextAdmitted)
+        if (s != space && s->allowance > PFF_MIN_FRAMES
+            && stats->totalTicks - s->faultTime > PFF_IDLE) {
+            freed += s->allowance - PFF_MIN_FRAMES;
+            s->allowance = PFF_MIN_FRAMES;
+        }
+    committed -= freed;
+    return freed;
+}
+
+//------------------------------------------
+//  void CoreMap::Grow(AddrSpace *space, int count)
+//  Si space (el proceso actual) entra con count
+//  marcos más, se los damos (o los que entren).
+//  Si hace falta, primero se achica la reserva de
+//  los que no están usando la suya (Squeeze).
+//  Si no entra ninguno, se lo suspende: libera sus
+//  marcos y espera a que le hagan lugar, en vez de
+//  quitárselos a los demás y que fallen todos.
+//  Pero si los demás no usan más que el mínimo (ej:
+//  el shell, que lo espera), no hay a quién ayudar:
+//  puede usar toda la memoria.
+//------------------------------------------
+void CoreMap::Grow(AddrSpace *space, int count) {
+    if (committed + count > MEMORY_BUDGET)
+        Squeeze(space);
+
+    int room = MEMORY_BUDGET - committed;
+    bool alone = committed - space->allowance
+                 <= PFF_MIN_FRAMES * (numAdmitted - 1);
+
+    if (room <= 0 && !alone) {
+        Suspend(space);
+        return;
+    }
+    if (!alone && count > room)
+        count = room;
+    if (count > NumPhysPages - space->allowance)
+        count = NumPhysPages - space->allowance;
+    if (count > 0) {
+        space->allowance += count;
+        committed += count;
+    }
+}
+
+//------------------------------------------
+//  void CoreMap::Shrink(AddrSpace *space)
+//  Las páginas que sobran se desalojan en los
+//  próximos fallos (Trim)
+//------------------------------------------
+void CoreMap::Shrink(AddrSpace *space) {
+    if (space->allowance <= PFF_MIN_FRAMES)
+        return;
+    space->allowance--;
+    committed--;
+    Readmit(false);
+}
+
+//------------------------------------------
+//  void CoreMap::Suspend(AddrSpace *space)
+//  Bloquea al proceso actual, dueño de space,
+//  hasta que Readmit lo vuelva a admitir (con el
+//  marco más que pedía)
+//------------------------------------------
+void CoreMap::Suspend(AddrSpace *space) {
+    Suspension wait;
+    Suspension **last = &suspended;
+
+    DEBUG('a', "----- Suspending address space, %d frames\n",
+          space->allowance);
+    stats->numSuspensions++;
+    Unlink(space);
+    // mientras espera, sus marcos les sirven a los demás
+    for (int frame = 0; frame < NumPhysPages; frame++)
+        if (pages[frame].space == space && !pages[frame].text
+            && pages[frame].refs == 1 && !pages[frame].pinned)
+            Release(frame);
+
+    wait.space = space;
+    wait.resume = new Semaphore("suspended", 0);
+    wait.since = stats->totalTicks;
+    wait.next = NULL;
+    while (*last != NULL)
+        last = &(*last)->next;
+    *last = &wait;
+    Readmit(false);     // quizás entra otro que esperaba
+    wait.resume->P();
+    delete wait.resume;
+    DEBUG('a', "----- Resuming address space, %d frames\n",
+          space->allowance);
+}
+
+//------------------------------------------
+//  void CoreMap::Readmit(bool force)
+//  Vuelve a admitir a los suspendidos, en orden,
+//  mientras entren (o si no queda nadie admitido).
+//  Con force, al primero aunque no entre.
+//------------------------------------------
+void CoreMap::Readmit(bool force) {
+    while (suspended != NULL) {
+        Suspension *first = suspended;
+        int need = first->space->allowance + 1;
+
+        if (committed + need > MEMORY_BUDGET && numAdmitted > 0 && !force)
+            break;
+        force = false;
+        suspended = first->next;
+        first->space->allowance = need;
+        first->space->faultTime = stats->totalTicks;  // no está inactivo
+        committed += need;
+        numAdmitted++;
+        first->space->nextAdmitted = admitted;
+        admitted = first->space;
+        first->resume->V();
+    }
+}
+
+//------------------------------------------
+//  bool CoreMap::Trim(AddrSpace *space)
+//  Segunda oportunidad, sólo entre los marcos que
+//  son de space y de nadie más
+//------------------------------------------
+bool CoreMap::Trim(AddrSpace *space) {
+    for (int i = 0; i < 2 * NumPhysPages; i++) {
+        int frame = trimHand;
+
+        trimHand = (trimHand + 1) % NumPhysPages;
+        if (pages[frame].space != space || pages[frame].text
+            || pages[frame].refs != 1 || pages[frame].pinned)
+            continue;
+        if (Referenced(frame))
+            continue;
+        Release(frame);
+        stats->numLocalEvictions++;
+        return true;
+    }
+    return false;
+}
+
+//------------------------------------------
+//  SharedText *CoreMap::AttachText(AddrSpace *space,
+//                                  int fileId, int numPages)
+//  Si otro proceso ya corre el mismo ejecutable,
+//  compartimos sus páginas de código
+//------------------------------------------
+SharedText *CoreMap::AttachText(AddrSpace *space, int fileId, int numPages) {
+    SharedText *text = texts;
+
+    while (text != NULL
+           && (text->fileId != fileId || text->numPages != numPages))
+        text = text->next;
+    if (text == NULL) {
+        text = new SharedText;
+        text->fileId = fileId;
+        text->numPages = numPages;
+        text->frames = new int[numPages];
+        text->loading = new bool[numPages];
+        for (int i = 0; i < numPages; i++) {
+            text->frames[i] = -1;
+            text->loading[i] = false;
+        }
+        text->lock = new Lock("shared text");
+        text->loaded = new Condition("shared text loaded", text->lock);
+        text->maxSpaces = 4;
+        text->spaces = new AddrSpace *[text->maxSpaces];
+        text->numSpaces = 0;
+        text->next = texts;
+        texts = text;
+    }
+    if (text->numSpaces == text->maxSpaces) {
+        AddrSpace **bigger = new AddrSpace *[2 * text->maxSpaces];
+        for (int i = 0; i < text->numSpaces; i++)
+            bigger[i] = text->spaces[i];
+        delete [] text->spaces;
+        text->spaces = bigger;
+        text->maxSpaces *= 2;
+    }
+    text->spaces[text->numSpaces++] = space;
+    return text;
+}
+
+//------------------------------------------
+//  void CoreMap::DetachText(SharedText *text,
+//                           AddrSpace *space)
+//  Se llama cuando se destruye space: suelta las
+//  páginas de código que tenía, y el código mismo
+//  si era el último que lo usaba
+//------------------------------------------
+void CoreMap::DetachText(SharedText *text, AddrSpace *space) {
+    int i;
+
+    for (i = 0; i < text->numSpaces; i++)
+        if (text->spaces[i] == space)
+            break;
+    ASSERT(i < text->numSpaces);
+    text->spaces[i] = text->spaces[--text->numSpaces];
+
+    for (int vpn = 0; vpn < text->numPages; vpn++) {
+        int frame = text->frames[vpn];
+
+        if (frame == -1 || space->pageTable[vpn].physicalPage != frame)
+            continue;
+        if (--pages[frame].refs == 0) {
+            Clear(frame);
+            text->frames[vpn] = -1;
+        } else if (pages[frame].space == space) {
+            // el marco queda a nombre de otro que lo tenga
+            for (int j = 0; j < text->numSpaces; j++)
+                if (text->spaces[j]->pageTable[vpn].physicalPage == frame) {
+                    pages[frame].space = text->spaces[j];
+                    pages[frame].entry = &text->spaces[j]->pageTable[vpn];
+                    break;
+                }
+        }
+    }
+
+    if (text->numSpaces == 0) {
+        Forget(NULL, text);
+        SharedText **link = &texts;
+        while (*link != text)
+            link = &(*link)->next;
+        *link = text->next;
+        delete [] text->frames;
+        delete [] text->loading;
+        delete text->loaded;
+        delete text->lock;
+        delete [] text->spaces;
+        delete text;
+    }
+}
+
+//------------------------------------------
+//  int CoreMap::MapText(SharedText *text, AddrSpace *space,
+//                       TranslationEntry *entry, bool *load)
+//  Si otro proceso está cargando la página (la
+//  lectura puede bloquearse, o puede perder la CPU),
+//  esperamos a que termine: el marco todavía no
+//  tiene el código
+//------------------------------------------
+int CoreMap::MapText(SharedText *text, AddrSpace *space,
+                     TranslationEntry *entry, bool *load) {
+    int vpn = entry->virtualPage;
+    int frame;
+
+    ASSERT(vpn < text->numPages);
+    if (text->loading[vpn]) {
+        text->lock->Acquire();
+        while (text->loading[vpn])
+            text->loaded->Wait();
+        text->lock->Release();
+    }
+    frame = text->frames[vpn];
+    if (frame != -1) {
+        pages[frame].refs++;
+        *load = false;
+        return frame;
+    }
+    frame = Reclaim(space, text, entry);
+    if (frame != -1) {
+        text->frames[vpn] = frame;
+        *load = false;
+        return frame;
+    }
+    text->loading[vpn] = true;  // antes de Find, que puede bloquearse
+    frame = Find(space, entry);
+    pages[frame].text = text;
+    text->frames[vpn] = frame;
+    *load = true;
+    return frame;
 }
+
+//------------------------------------------
+//  void CoreMap::TextLoaded(SharedText *text, int vpn)
+//  Despierta a los que esperan la página en MapText
+//------------------------------------------
+void CoreMap::TextLoaded(SharedText *text, int vpn) {
+    text->lock->Acquire();
+    text->loading[vpn] = false;
+    text->loaded->Broadcast();
+    text->lock->Release();
+}
+
+//------------------------------------------
+//  void CoreMap::Share(int frame, AddrSpace *space,
+//                      TranslationEntry *entry)
+//------------------------------------------
+void CoreMap::Share(int frame, AddrSpace *space, TranslationEntry *entry) {
+    ASSERT(pages[frame].space && !pages[frame].text);
+    space->cowNext[entry->virtualPage] = pages[frame].space;
+    pages[frame].space = space;
+    pages[frame].entry = entry;
+    pages[frame].refs++;
+}
+
+//------------------------------------------
+//  void CoreMap::Unshare(int frame, AddrSpace *space, int vpn)
+//------------------------------------------
+void CoreMap::Unshare(int frame, AddrSpace *space, int vpn) {
+    ASSERT(pages[frame].refs > 0 && !pages[frame].text);
+    if (pages[frame].refs == 1) {
+        ASSERT(pages[frame].space == space);
+        Clear(frame);
+        return;
+    }
+    if (pages[frame].space == space) {
+        pages[frame].space = space->cowNext[vpn];
+        pages[frame].entry = &pages[frame].space->pageTable[vpn];
+    } else {
+        AddrSpace *prev = pages[frame].space;
+        while (prev->cowNext[vpn] != space)
+            prev = prev->cowNext[vpn];
+        prev->cowNext[vpn] = space->cowNext[vpn];
+    }
+    space->cowNext[vpn] = NULL;
+    pages[frame].refs--;
+}
+
+//------------------------------------------
+//  int CoreMap::CopyOnWrite(int frame, AddrSpace *space,
+//                           TranslationEntry *entry)
+//  Si space es el único que queda, el marco ya es suyo
+//------------------------------------------
+int CoreMap::CopyOnWrite(int frame, AddrSpace *space, TranslationEntry *entry) {
+    if (pages[frame].refs == 1)
+        return frame;
+
+    Pin(frame);                 // que no lo elija Find
+    int copy = Find(space, entry);
+    Unpin(frame);
+    memcpy(&machine->mainMemory[copy * PageSize],
+           &machine->mainMemory[frame * PageSize], PageSize);
+    Unshare(frame, space, entry->virtualPage);
+    return copy;
+}
+
+//------------------------------------------
+//  void CoreMap::DropText(int frame)
+//  Saca una página de código compartida de todos
+//  los procesos que la tienen
+//------------------------------------------
+void CoreMap::DropText(int frame) {
+    SharedText *text = pages[frame].text;
+    int vpn = pages[frame].entry->virtualPage;
+
+    for (int i = 0; i < text->numSpaces; i++)
+        if (text->spaces[i]->pageTable[vpn].physicalPage == frame)
+            text->spaces[i]->DropPage(vpn);
+    text->frames[vpn] = -1;
+    pages[frame].text = NULL;
+    machine->InvalidateDecodedPage(frame);
+}
+
+//------------------------------------------
+//  void CoreMap::Enqueue(int frame, int queue)
+//  Pone el marco al final de la cola "queue"
+//------------------------------------------
+void CoreMap::Enqueue(int frame, int queue) {
+    pages[frame].queue = queue;
+    pages[frame].older = newest[queue];
+    pages[frame].newer = -1;
+    if (newest[queue] != -1)
+        pages[newest[queue]].newer = frame;
+    else
+        oldest[queue] = frame;
+    newest[queue] = frame;
+    queueLength[queue]++;
+}
+
+//------------------------------------------
+//  void CoreMap::Dequeue(int frame)
+//------------------------------------------
+void CoreMap::Dequeue(int frame) {
+    int queue = pages[frame].queue;
+    int older = pages[frame].older, newer = pages[frame].newer;
+
+    if (older != -1)
+        pages[older].newer = newer;
+    else
+        oldest[queue] = newer;
+    if (newer != -1)
+        pages[newer].older = older;
+    else
+        newest[queue] = older;
+    pages[frame].older = pages[frame].newer = -1;
+    queueLength[queue]--;
+}
+
+//------------------------------------------
+//  bool CoreMap::Remembered(AddrSpace *space, int vpn)
+//  Si la página está entre las desalojadas hace
+//  poco (A1out de 2Q); si está, la olvida
+//------------------------------------------
+bool CoreMap::Remembered(AddrSpace *space, int vpn) {
+    for (int i = 0; i < NUM_GHOSTS; i++)
+        if (ghosts[i].space == space && ghosts[i].vpn == vpn) {
+            ghosts[i].space = NULL;
+            return true;
+        }
+    return false;
+}
+
+//------------------------------------------
+//  TranslationEntry *CoreMap::InTLB(int frame,
+//                                   AddrSpace *space)
+//  Con TLB, los bits de uso y modificación de las
+//  páginas que están en la TLB (de cualquier
+//  proceso) están al día ahí y no en su tabla de
+//  páginas. Devuelve la entrada de la TLB con la
+//  que space ve el marco, si la tiene.
+//------------------------------------------
+TranslationEntry *CoreMap::InTLB(int frame, AddrSpace *space) {
+#ifdef USE_TLB
+    int vpn = pages[frame].entry->virtualPage;
+
+    if (space != NULL && space->pageTable[vpn].physicalPage == frame) {
+        int slot = space->TLBSlot(vpn);
+        if (slot >= 0)
+            return &machine->tlb[slot];
+    }
 #endif
+    return NULL;
+}
+
+//------------------------------------------
+//  bool CoreMap::Referenced(int frame)
+//  Si el marco se usó desde la última vez que se
+//  preguntó (borra el bit de uso)
+//------------------------------------------
+bool CoreMap::Referenced(int frame) {
+    TranslationEntry *cached = InTLB(frame, pages[frame].space);
+    bool use = pages[frame].entry->use || (cached && cached->use);
+    SharedText *text = pages[frame].text;
+
+    pages[frame].entry->use = false;
+    if (cached)
+        cached->use = false;
+    // el código compartido puede estar en la TLB de cada proceso
+    for (int i = 0; text != NULL && i < text->numSpaces; i++) {
+        if (text->spaces[i] == pages[frame].space)
+            continue;
+        cached = InTLB(frame, text->spaces[i]);
+        if (cached) {
+            use = use || cached->use;
+            cached->use = false;
+        }
+    }
+    return use;
+}
+
+//------------------------------------------
+//  bool CoreMap::Dirty(int frame)
+//------------------------------------------
+bool CoreMap::Dirty(int frame) {
+    TranslationEntry *cached = InTLB(frame, pages[frame].space);
+
+    return pages[frame].entry->dirty || (cached && cached->dirty);
+}
+
+//------------------------------------------
+//  int CoreMap::fifo_find()
+//  El marco que entró primero, salteando
+//  los fijados
+//------------------------------------------
+int CoreMap::fifo_find() {
+    for (int frame = oldest[0]; frame != -1; frame = pages[frame].newer)
+        if (!pages[frame].pinned)
+            return frame;
+    return -1;
+}
+
+//------------------------------------------
+//  int CoreMap::clock_find()
+//  Segunda oportunidad: la aguja avanza sacándole
+//  el bit de uso a los marcos que lo tienen, hasta
+//  encontrar uno que no lo tenía
+//------------------------------------------
+int CoreMap::clock_find() {
+    for (int i = 0; i < 2 * NumPhysPages; i++) {
+        int frame = hand;
+
+        hand = (hand + 1) % NumPhysPages;
+        if (Evictable(frame) && !Referenced(frame))
+            return frame;
+    }
+    return -1;
+}
 
+//------------------------------------------
+//  int CoreMap::eclock_find()
+//  Segunda oportunidad mejorada: la aguja da una
+//  vuelta sacándole el bit de uso a los marcos que
+//  lo tienen, y se queda con el primero que no
+//  estaba usado ni modificado. Si no hay, con el
+//  primero no usado pero modificado; si estaban
+//  todos usados, en la segunda vuelta ya no lo están.
+//------------------------------------------
+int CoreMap::eclock_find() {
+    int dirtyVictim = -1;
+
+    for (int i = 0; i < 2 * NumPhysPages; i++) {
+        int frame = hand;
+
+        hand = (hand + 1) % NumPhysPages;
+        if (Evictable(frame) && !Referenced(frame)) {
+            if (!Dirty(frame))
+                return frame;
+            if (dirtyVictim == -1)
+                dirtyVictim = frame;
+        }
+        if (i == NumPhysPages - 1 && dirtyVictim != -1)
+            return dirtyVictim;
+    }
+    return dirtyVictim;
+}
+
+//------------------------------------------
+//  int CoreMap::wsclock_find()
+//  WSClock: como el reloj, pero un marco no usado
+//  sólo es víctima si además salió del conjunto de
+//  trabajo (hace WSCLOCK_WINDOW ticks que no se
+//  usa). A los usados la aguja les anota la hora.
+//  Si en una vuelta no aparece uno viejo y limpio,
+//  se elige uno viejo modificado, y si no, el que
+//  hace más tiempo que no se usa.
+//------------------------------------------
+int CoreMap::wsclock_find() {
+    int now = stats->totalTicks;
+    int oldDirty = -1, lru = -1;
+
+    for (int i = 0; i < NumPhysPages; i++) {
+        int frame = hand;
+
+        hand = (hand + 1) % NumPhysPages;
+        if (!Evictable(frame))
+            continue;
+        if (Referenced(frame))
+            pages[frame].lastUse = now;
+        else if (now - pages[frame].lastUse > WSCLOCK_WINDOW) {
+            if (!Dirty(frame))
+                return frame;
+            if (oldDirty == -1)
+                oldDirty = frame;
+        }
+        if (lru == -1 || pages[frame].lastUse < pages[lru].lastUse)
+            lru = frame;
+    }
+    if (oldDirty != -1)
+        return oldDirty;
+    return lru;
+}
+
+//------------------------------------------
+//  void CoreMap::Sample()
+//  Con Aging, en cada interrupción del timer se
+//  corre un lugar el contador de cada marco, y se
+//  le pone arriba el bit de uso. También despierta
+//  al suspendido que esperó demasiado.
+//------------------------------------------
+void CoreMap::Sample() {
+    // quizás ya hay lugar para los suspendidos; y si los admitidos
+    // los esperan, no les van a hacer lugar
+    if (suspended != NULL && Squeeze(NULL) > 0)
+        Readmit(false);
+    if (suspended != NULL
+        && stats->totalTicks - suspended->since > SUSPEND_TICKS)
+        Readmit(true);
+    if (policy != AgingReplacement)
+        return;
+    for (int frame = 0; frame < NumPhysPages; frame++)
+        if (pages[frame].refs > 0)
+            pages[frame].age = (pages[frame].age >> 1)
+                               | (Referenced(frame) ? 0x80 : 0);
+}
+
+//------------------------------------------
+//  int CoreMap::aging_find()
+//  El marco con el contador más bajo, es decir el
+//  que hace más que no se usa; entre iguales, uno
+//  limpio. Empieza a buscar donde quedó la aguja,
+//  para no elegir siempre los primeros.
+//------------------------------------------
+int CoreMap::aging_find() {
+    int victim = -1;
+
+    for (int i = 0; i < NumPhysPages; i++) {
+        int frame = (hand + i) % NumPhysPages;
+
+        if (!Evictable(frame))
+            continue;
+        if (victim == -1 || pages[frame].age < pages[victim].age
+            || (pages[frame].age == pages[victim].age
+                && Dirty(victim) && !Dirty(frame)))
+            victim = frame;
+    }
+    if (victim != -1)
+        hand = (victim + 1) % NumPhysPages;
+    return victim;
+}
+
+//------------------------------------------
+//  int CoreMap::twoq_find()
+//  2Q: las páginas entran a A1in (cola 0), y sólo
+//  pasan a Am (cola 1) si se las vuelve a pedir
+//  poco después de desalojarlas. Así una recorrida
+//  de una sola vez no echa a las que se usan
+//  seguido. Mientras A1in tenga más de un cuarto de
+//  los marcos, la víctima sale de ahí (FIFO), y se
+//  la recuerda en A1out; si no, de Am, con segunda
+//  oportunidad.
+//------------------------------------------
+int CoreMap::twoq_find() {
+    if (queueLength[0] > NumPhysPages / 4 || queueLength[1] == 0) {
+        for (int frame = oldest[0]; frame != -1; frame = pages[frame].newer)
+            if (!pages[frame].pinned) {
+                ghosts[nextGhost].space = pages[frame].space;
+                ghosts[nextGhost].vpn = pages[frame].entry->virtualPage;
+                nextGhost = (nextGhost + 1) % NUM_GHOSTS;
+                return frame;
+            }
+    }
+    for (int i = 0; i < 2 * queueLength[1]; i++) {
+        int frame = oldest[1];
+
+        Dequeue(frame);
+        Enqueue(frame, 1);
+        if (!pages[frame].pinned && !Referenced(frame))
+            return frame;
+    }
+    return fifo_find();     // todo Am fijado: cualquiera de A1in
+}
@@ -1,33 +1,213 @@
 #ifndef COREMAP_H
-#define COREMAP_
+#define COREMAP_H
 
 #include "copyright.h"
 #include "bitmap.h"
 #include "addrspace.h"
 #include "machine.h"
-#include "list.h"
+#include "synch.h"
 //#include "system.h"
 
+// Políticas de reemplazo de páginas, para elegir el marco a desalojar
+// cuando no queda ninguno libre. Se elige al arrancar (-vm)
+enum ReplacementPolicy {
+    FifoReplacement,            // el que entró primero
+    ClockReplacement,           // segunda oportunidad
+    EnhancedClockReplacement,   // segunda oportunidad, prefiriendo limpios
+    WSClockReplacement,         // el reloj con conjunto de trabajo
+    AgingReplacement,           // contador de envejecimiento (LRU aprox.)
+    TwoQReplacement             // 2Q: los que se usaron una sola vez
+                                // primero
+};
+
+extern ReplacementPolicy ReplacementNamed(const char *name);
+extern const char *ReplacementName(ReplacementPolicy policy);
+
+// Con WSClockReplacement, un marco que no se usó en esta cantidad de ticks ya no
+// está en el conjunto de trabajo de su proceso
+#ifndef WSCLOCK_WINDOW
+#define WSCLOCK_WINDOW 10000
+#endif
+
+// Páginas de código de un ejecutable, compartidas (sólo lectura) por
+// todos los procesos que lo corren. Cada proceso que la usa la tiene
+// en su tabla de páginas, y el marco cuenta cuántos la tienen.
+typedef struct SharedText {
+    int fileId;                 // identidad del ejecutable
+    int numPages;               // páginas que son sólo código
+    int *frames;                // marco de cada una, -1 si no está
+    bool *loading;              // si alguien la está cargando: los demás
+                                // esperan en "loaded" a que termine
+    Lock *lock;
+    Condition *loaded;
+    AddrSpace **spaces;         // procesos que la comparten
+    int numSpaces, maxSpaces;
+    struct SharedText *next;    // siguiente código compartido en uso
+} SharedText;
+
 typedef struct CoreMapEntry {
     AddrSpace *space;
     TranslationEntry *entry;
-    //int vpn;
+    int pinned;         // veces que está fijado: el kernel está
+                        // copiando en el marco, no se puede elegir
+                        // como víctima
+    SharedText *text;   // si es código compartido, de quién
+    int refs;           // tablas de páginas que lo tienen, 0 si está
+                        // libre (si no es código, están encadenadas
+                        // desde space por AddrSpace::cowNext)
+    int lastUse;        // último tick en que se lo vio usado (WSCLOCK)
+    int vpn;            // en POOL_QUEUE: la página que todavía tiene
+    int age;            // bits de uso muestreados, el más reciente
+                        // arriba (Aging)
+    int queue;          // cola en la que está (2Q: A1in o Am; o la
+                        // de los liberados por el pager)
+    int older, newer;   // vecinos en esa cola, por orden de llegada;
+                        // -1 si no hay
 } CoreMapEntry;
 
+// Página desalojada hace poco, que 2Q recuerda (A1out)
+typedef struct GhostPage {
+    AddrSpace *space;
+    int vpn;
+} GhostPage;
+
+// El pager se despierta cuando quedan PAGER_LOW marcos libres, y
+// libera hasta que haya PAGER_HIGH
+#define PAGER_LOW (NumPhysPages / 8)
+#define PAGER_HIGH (NumPhysPages / 4)
+
+// Conjunto residente de cada proceso (PFF): arranca con PFF_MIN_FRAMES
+// marcos; si ya los usa todos y vuelve a fallar antes de PFF_GROW ticks
+// de usuario (suyos) desde el fallo anterior, se le dan los que trae un
+// fallo (AddrSpace::FaultAround), y si tarda más de PFF_SHRINK, uno
+// menos. Los procesos admitidos no suman
+// más de MEMORY_BUDGET; el que no entra se suspende hasta que haya
+// lugar, o hasta que pasen SUSPEND_TICKS (por si los otros lo esperan).
+// Al que no falla hace PFF_IDLE ticks (ej: espera un Join) se le baja la
+// reserva al mínimo, para hacer lugar.
+#define PFF_MIN_FRAMES 4
+#define PFF_GROW 2000
+#define PFF_SHRINK 20000
+#define PFF_IDLE 50000
+#define MEMORY_BUDGET (NumPhysPages - PAGER_HIGH)
+#define SUSPEND_TICKS 100000
+
+// Un proceso suspendido, esperando que le hagan lugar
+typedef struct Suspension {
+    AddrSpace *space;
+    Semaphore *resume;          // lo despierta Readmit
+    int since;                  // desde cuándo espera
+    struct Suspension *next;    // el que se suspendió después
+} Suspension;
+
+#define NUM_QUEUES 3
+#define POOL_QUEUE 2    // marcos liberados por el pager, con su página
+#define NUM_GHOSTS (NumPhysPages / 2)
+
 class CoreMap {
   public:
-    CoreMap();
+    CoreMap(ReplacementPolicy replacement);
     ~CoreMap();
     
     int Find(AddrSpace *space, TranslationEntry *entry);
+    int FindFree(AddrSpace *space, TranslationEntry *entry);
+                        // Como Find, pero sólo si sobran marcos
+                        // disponibles (para leer por adelantado); si
+                        // no, -1
     void Clear(int frame);
+    void Pin(int frame);
+    void Unpin(int frame);
+    void Sample();      // Lo llama el timer: envejece los marcos, y
+                        // despierta a los suspendidos hace mucho
+    void Pageout();     // El hilo del pager (no vuelve)
+    int Reclaim(AddrSpace *space, SharedText *text, TranslationEntry *entry);
+                        // Marco liberado que todavía tiene la página
+                        // "entry" (de text, si no es NULL), o -1
+    void Forget(AddrSpace *space, SharedText *text);
+                        // Suelta esos marcos (se destruye space o text)
+
+    void Admit(AddrSpace *space);
+                        // Proceso nuevo: le reserva PFF_MIN_FRAMES
+    void Leave(AddrSpace *space);
+                        // Termina: libera su reserva
+    void Grow(AddrSpace *space, int count);
+                        // Falla seguido: count marcos más, si entran; si
+                        // no, lo suspende hasta que haya lugar
+    void Shrink(AddrSpace *space);
+                        // Falla poco: un marco menos
+    bool Trim(AddrSpace *space);
+                        // Desaloja una página propia de space (reemplazo
+                        // local); false si no tiene ninguna
+
+    SharedText *AttachText(AddrSpace *space, int fileId, int numPages);
+                        // Empieza a compartir el código del ejecutable
+    void DetachText(SharedText *text, AddrSpace *space);
+                        // Deja de compartirlo (libera sus marcos)
+    int MapText(SharedText *text, AddrSpace *space,
+                TranslationEntry *entry, bool *load);
+                        // Marco de la página de código "entry"; si no
+                        // estaba, pone *load en true (hay que cargarla,
+                        // y después llamar a TextLoaded)
+    void TextLoaded(SharedText *text, int vpn);
+                        // Terminó de cargarse la página vpn del código
+
+    void Share(int frame, AddrSpace *space, TranslationEntry *entry);
+                        // space también tiene el marco (Fork)
+    void Unshare(int frame, AddrSpace *space, int vpn);
+                        // space ya no lo tiene; se libera con el último
+    int CopyOnWrite(int frame, AddrSpace *space, TranslationEntry *entry);
+                        // Marco propio de space con el contenido de frame
 
   private:
-	List <int> *physframes;
-    CoreMapEntry pages[NumPhysPages];
-    int usedPages;
-    int clock_find(bool use, bool dirty);
+    ReplacementPolicy policy;
+    SharedText *texts;              // códigos compartidos en uso
+    CoreMapEntry pages[NumPhysPages];   // los marcos, en círculo para
+                                        // la aguja del reloj
+    int hand;                       // próximo marco que mira el reloj
+    int freeFrames[NumPhysPages];   // pila de marcos libres
+    int numFree;
+    int oldest[NUM_QUEUES], newest[NUM_QUEUES];
+                                    // extremos de cada cola
+    int queueLength[NUM_QUEUES];
+    GhostPage ghosts[NUM_GHOSTS];   // A1out de 2Q, circular
+    int nextGhost;
+    Semaphore *pagerWake;           // para despertar al pager
+    bool pagerAwake;                // ya se lo despertó
+    int committed;                  // marcos reservados por los
+                                    // procesos admitidos
+    int numAdmitted;
+    AddrSpace *admitted;            // los admitidos, encadenados por
+                                    // AddrSpace::nextAdmitted
+    Suspension *suspended;          // el que espera hace más, primero
+    int trimHand;                   // próximo marco que mira Trim
+    void Suspend(AddrSpace *space);
+    int Squeeze(AddrSpace *space);
+    void Unlink(AddrSpace *space);
+    void Readmit(bool force);
+    void Release(int frame);
+    int Take();
+    int Victim();
+    void Evict(int frame);
+    void Assign(int frame, AddrSpace *space, TranslationEntry *entry,
+                int queue);
+    bool Holds(int frame, AddrSpace *space, SharedText *text);
+    int Available()                 // marcos que se pueden usar ya
+        { return numFree + queueLength[POOL_QUEUE]; }
+    bool Evictable(int frame)       // ocupado y no fijado
+        { return pages[frame].refs > 0 && !pages[frame].pinned; }
+    int fifo_find();
     int clock_find();
+    int eclock_find();
+    int wsclock_find();
+    int aging_find();
+    int twoq_find();
+    void Enqueue(int frame, int queue);
+    void Dequeue(int frame);
+    bool Remembered(AddrSpace *space, int vpn);
+    TranslationEntry *InTLB(int frame, AddrSpace *space);
+    bool Referenced(int frame);
+    bool Dirty(int frame);
+    void DropText(int frame);
 };
 
-#endif // BITMAP_H
+#endif // COREMAP_H